@@ -13,6 +13,7 @@
 #include "mncore/file.h"
 #include "mncore/history.h"
 #include "mncore/logger.h"
+#include "mncore/memo.h"
 #include "mncore/node.h"
 #include "mncore/serialize.h"
 #include "mncore/store.h"
@@ -120,7 +121,7 @@ class iApp {
   virtual void Quit() = 0;
 
 
-  void Exec(std::function<void(void)>&& f) {
+  void Exec(Task::F&& f) {
     main_.Exec(std::move(f));
   }
   void ExecCommand(std::unique_ptr<iCommand>&& cmd) {
@@ -167,6 +168,10 @@ class iApp {
     return gl3_;
   }
 
+  MemoCache& memo() {
+    return memo_;
+  }
+
  private:
   const iClock* clock_;
 
@@ -186,6 +191,8 @@ class iApp {
 
 
   TaskQueue main_, cpu_, gl3_;
+
+  MemoCache memo_;
 };
 
 }  // namespace mnian::core
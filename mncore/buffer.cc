@@ -0,0 +1,287 @@
+// No copyright
+#include "mncore/buffer.h"
+
+#include <array>
+#include <atomic>  // NOLINT(build/c++11)
+#include <bit>
+#include <cassert>
+#include <mutex>  // NOLINT(build/c++11)
+#include <new>
+#include <optional>
+#include <vector>
+
+#if defined(__linux__)
+# include <sys/mman.h>
+#endif
+
+#include "mncore/pool.h"
+
+
+namespace mnian::core {
+
+static constexpr size_t kMinShift =
+    static_cast<size_t>(std::bit_width(BufferPool::kMinSize-1));
+static_assert(size_t{1} << kMinShift == BufferPool::kMinSize);
+
+// 4 classes for each power of two, up to 64 GB
+static constexpr size_t kClasses = (36-kMinShift)*4+1;
+
+// A thread cache keeps at most this number of free buffers for each class,
+// and at most this bytes in total.
+static constexpr size_t kCacheCount = 4;
+static constexpr size_t kCacheBytes = 64*1024*1024;
+
+
+static constexpr size_t GetClassSize(size_t c) {
+  return (size_t{4+c%4} << (kMinShift+c/4)) >> 2;
+}
+static_assert(GetClassSize(0) == BufferPool::kMinSize);
+
+static size_t GetClass(size_t n) {
+  assert(n >= BufferPool::kMinSize);
+
+  // 2^(e-1) < n <= 2^e
+  const auto e = static_cast<size_t>(std::bit_width(n-1));
+
+  size_t c = e > kMinShift? (e-1-kMinShift)*4: 0;
+  while (GetClassSize(c) < n) ++c;
+  return c;
+}
+
+
+namespace {
+
+struct Entry final {
+ public:
+  std::byte* ptr;
+
+  bool huge;
+};
+
+// The global pool is never deleted because buffers might be released after
+// static destructors.
+struct Global final {
+ public:
+  static Global& instance() {
+    static auto ret = new Global;
+    return *ret;
+  }
+
+  std::mutex mtx;
+
+  std::array<std::vector<Entry>, kClasses> lists;
+
+  std::atomic<size_t> cap = BufferPool::kDefaultCap;
+
+  std::atomic<bool> huge = false;
+
+  std::atomic<size_t> live   = 0;
+  std::atomic<size_t> cached = 0;
+
+  std::atomic<uint64_t> hits      = 0;
+  std::atomic<uint64_t> misses    = 0;
+  std::atomic<uint64_t> evictions = 0;
+};
+
+
+struct Cache final {
+ public:
+  Cache() = default;
+  ~Cache();
+
+  std::array<std::vector<Entry>, kClasses> lists;
+
+  size_t bytes = 0;
+};
+
+thread_local Cache cache_;
+thread_local bool  cache_dead_ = false;
+
+
+std::byte* AllocatePages(size_t size, bool huge) {
+  if (!huge) {
+    return static_cast<std::byte*>(
+        ::operator new(size, std::align_val_t {BufferPool::kAlign}));
+  }
+
+  auto ret = static_cast<std::byte*>(
+      ::operator new(size, std::align_val_t {BufferPool::kHugePageSize}));
+#if defined(MADV_HUGEPAGE)
+  madvise(ret, size, MADV_HUGEPAGE);
+#endif
+  return ret;
+}
+
+void DeallocatePages(std::byte* ptr, bool huge) {
+  ::operator delete(
+      ptr,
+      std::align_val_t {huge? BufferPool::kHugePageSize: BufferPool::kAlign});
+}
+
+
+// Adds the size to the cached bytes, or returns false leaving them unchanged
+// if it exceeds the cap. The check includes own addition, so concurrent
+// releases can't overshoot the cap together.
+bool Reserve(size_t size) {
+  auto& g = Global::instance();
+  if (g.cached.fetch_add(size)+size <= g.cap.load()) return true;
+  g.cached -= size;
+  return false;
+}
+
+// Pushes the buffer to the global cache, or returns it to the OS when the
+// cache is full.
+void Return(size_t c, Entry e) {
+  auto&      g    = Global::instance();
+  const auto size = GetClassSize(c);
+
+  {
+    std::lock_guard<std::mutex> _(g.mtx);
+    if (Reserve(size)) {
+      g.lists[c].push_back(e);
+      return;
+    }
+  }
+  ++g.evictions;
+  DeallocatePages(e.ptr, e.huge);
+}
+
+// Returns free buffers of the global cache to the OS, from the largest,
+// until the cached bytes gets equal to or less than the cap.
+void Shrink(size_t cap) {
+  auto& g = Global::instance();
+
+  std::vector<Entry> drop;
+  {
+    std::lock_guard<std::mutex> _(g.mtx);
+    for (size_t c = kClasses; c-- > 0 && g.cached.load() > cap;) {
+      auto& list = g.lists[c];
+      while (list.size() && g.cached.load() > cap) {
+        drop.push_back(list.back());
+        list.pop_back();
+        g.cached -= GetClassSize(c);
+      }
+    }
+  }
+  for (auto& e : drop) DeallocatePages(e.ptr, e.huge);
+}
+
+Cache::~Cache() {
+  auto& g = Global::instance();
+  for (size_t c = 0; c < kClasses; ++c) {
+    for (auto& e : lists[c]) {
+      g.cached -= GetClassSize(c);
+      Return(c, e);
+    }
+  }
+  cache_dead_ = true;
+}
+
+
+class Deleter final {
+ public:
+  Deleter(size_t c, bool huge) : c_(c), huge_(huge) {
+  }
+
+  void operator()(std::byte* ptr) const {
+    auto&      g    = Global::instance();
+    const auto size = GetClassSize(c_);
+    g.live -= size;
+
+    if (!cache_dead_) {
+      auto& list = cache_.lists[c_];
+      if (list.size() < kCacheCount &&
+          cache_.bytes+size <= kCacheBytes &&
+          Reserve(size)) {
+        list.push_back({ptr, huge_});
+        cache_.bytes += size;
+        return;
+      }
+    }
+    Return(c_, {ptr, huge_});
+  }
+
+ private:
+  size_t c_;
+
+  bool huge_;
+};
+
+}  // namespace
+
+
+BufferPool::Buffer BufferPool::Allocate(size_t n) {
+  auto& g = Global::instance();
+
+  if (n < kMinSize || n > GetClassSize(kClasses-1)) {
+    auto ptr = AllocatePages(n, false);
+    return Buffer(
+        ptr,
+        [](std::byte* p) { DeallocatePages(p, false); },
+        PoolAllocator<std::byte>());
+  }
+
+  const auto c    = GetClass(n);
+  const auto size = GetClassSize(c);
+
+  std::optional<Entry> e;
+  if (!cache_dead_ && cache_.lists[c].size()) {
+    e = cache_.lists[c].back();
+    cache_.lists[c].pop_back();
+    cache_.bytes -= size;
+  } else {
+    std::lock_guard<std::mutex> _(g.mtx);
+    if (g.lists[c].size()) {
+      e = g.lists[c].back();
+      g.lists[c].pop_back();
+    }
+  }
+
+  if (e) {
+    g.cached -= size;
+    ++g.hits;
+  } else {
+    // Huge pages are used only when the buffer fills them.
+    const bool huge = g.huge.load() && size >= kHugePageSize;
+    const auto alloc =
+        huge? (size+kHugePageSize-1)/kHugePageSize*kHugePageSize: size;
+    e = Entry {AllocatePages(alloc, huge), huge};
+    ++g.misses;
+  }
+  g.live += size;
+
+  return Buffer(e->ptr, Deleter(c, e->huge), PoolAllocator<std::byte>());
+}
+
+void BufferPool::Trim() {
+  Shrink(0);
+}
+
+void BufferPool::cap(size_t n) {
+  Global::instance().cap = n;
+  Shrink(n);
+}
+size_t BufferPool::cap() {
+  return Global::instance().cap;
+}
+
+void BufferPool::hugePages(bool enable) {
+  Global::instance().huge = enable;
+}
+bool BufferPool::hugePages() {
+  return Global::instance().huge;
+}
+
+BufferPool::Stats BufferPool::stats() {
+  auto& g = Global::instance();
+  return Stats {
+    .live      = g.live.load(),
+    .cached    = g.cached.load(),
+    .cap       = g.cap.load(),
+    .hits      = g.hits.load(),
+    .misses    = g.misses.load(),
+    .evictions = g.evictions.load(),
+  };
+}
+
+}  // namespace mnian::core
@@ -0,0 +1,86 @@
+// No copyright
+//
+// This file declares a pool of large aligned buffers, such as tensor storages,
+// which recycles them instead of returning to the OS.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+namespace mnian::core {
+
+// BufferPool rounds requests up to size classes, 4 classes per power of two,
+// and keeps released buffers in free lists of each class. So a lambda which
+// produces a buffer of the same size on every execution gets the last one
+// back, without page faults of fresh memory.
+//
+// Each thread has a small cache of free buffers, and others are shared
+// through a global one guarded by a mutex. Released buffers exceeding the cap
+// of cached bytes are returned to the OS.
+//
+// All functions are thread-safe.
+class BufferPool final {
+ public:
+  static constexpr size_t kAlign = 64;
+
+  // Smaller requests are not pooled, because malloc is good at them.
+  static constexpr size_t kMinSize = 4*1024;
+
+  // Buffers larger than this are allocated with huge pages when enabled.
+  static constexpr size_t kHugePageSize = 2*1024*1024;
+
+  static constexpr size_t kDefaultCap = 512*1024*1024;
+
+
+  using Buffer = std::shared_ptr<std::byte>;
+
+
+  struct Stats final {
+   public:
+    double hitRatio() const {
+      const auto total = hits+misses;
+      return total? static_cast<double>(hits)/static_cast<double>(total): 0;
+    }
+
+    // bytes of buffers currently used, rounded up to their classes
+    size_t live = 0;
+
+    // bytes of free buffers kept in the pool
+    size_t cached = 0;
+
+    size_t cap = 0;
+
+    uint64_t hits   = 0;
+    uint64_t misses = 0;
+
+    // a number of released buffers returned to the OS because of the cap
+    uint64_t evictions = 0;
+  };
+
+
+  BufferPool() = delete;
+
+
+  // Returns a buffer aligned to kAlign, whose contents are undefined. It
+  // returns to the pool when the last reference is dropped.
+  static Buffer Allocate(size_t n);
+
+  // Returns all free buffers in the global cache to the OS. Buffers in thread
+  // caches are returned when the threads exit.
+  static void Trim();
+
+  // Lowering the cap trims the global cache.
+  static void cap(size_t n);
+  static size_t cap();
+
+  // Enables transparent huge pages for buffers allocated after this. It's
+  // ignored on platforms without them.
+  static void hugePages(bool enable);
+  static bool hugePages();
+
+  static Stats stats();
+};
+
+}  // namespace mnian::core
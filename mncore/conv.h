@@ -14,6 +14,9 @@
 #include <type_traits>
 #include <variant>
 
+#include "mncore/tensor.h"
+#include "mncore/vec.h"
+
 
 namespace mnian::core {
 
@@ -29,7 +32,11 @@ using SharedAny = std::variant<
     int64_t,
     double,
     bool,
-    std::shared_ptr<std::string>>;
+    std::shared_ptr<std::string>,
+    std::shared_ptr<const Tensor>,
+    Vec2,
+    Vec3,
+    Vec4>;
 
 
 template <typename R, typename T>
@@ -152,6 +159,21 @@ static inline Any FromSharedAny(const SharedAny& in) {
   if (std::holds_alternative<std::shared_ptr<std::string>>(in)) {
     return *std::get<std::shared_ptr<std::string>>(in);
   }
+  // Tensor is encoded into string, and iNode::Socket::Restore() decodes it.
+  if (std::holds_alternative<std::shared_ptr<const Tensor>>(in)) {
+    const auto& t = std::get<std::shared_ptr<const Tensor>>(in);
+    return t? t->Encode(): std::string();
+  }
+  // So are vectors, though iSerializer::SerializeSharedAny() makes arrays.
+  if (std::holds_alternative<Vec2>(in)) {
+    return StringifyVec(std::get<Vec2>(in));
+  }
+  if (std::holds_alternative<Vec3>(in)) {
+    return StringifyVec(std::get<Vec3>(in));
+  }
+  if (std::holds_alternative<Vec4>(in)) {
+    return StringifyVec(std::get<Vec4>(in));
+  }
   assert(false);
   return {};
 }
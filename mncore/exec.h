@@ -0,0 +1,143 @@
+// No copyright
+//
+// This file declares a controller which coalesces execution requests of a node
+// made during interactive edits.
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+#include "mncore/node.h"
+
+
+namespace mnian::core {
+
+// ExecController keeps at most one running process and one pending request,
+// and a new request overwrites the pending one, so the latest inputs always
+// win and stale ones are dropped without being executed. This is not
+// thread-safe.
+//
+// ## Example
+// ```
+// // on input changes
+// ctrl.Request();
+//
+// // every frame
+// if (ctrl.Poll()) ctrl.Start(node->EnqueueLambda(core::iNode::kFull));
+//
+// // when the result is received or the process is aborted
+// ctrl.Done();
+// ```
+class ExecController final {
+ public:
+  // The running process is allowed to finish when its progress reaches this,
+  // instead of being aborted by a new request.
+  static constexpr double kDefaultSpeculation = .8;
+
+
+  struct Stats final {
+   public:
+    uint64_t requests = 0;
+    uint64_t runs     = 0;
+
+    // requests overwritten by newer ones before started
+    uint64_t dropped = 0;
+
+    // runs aborted in favor of newer requests
+    uint64_t aborted = 0;
+  };
+
+
+  explicit ExecController(double speculation = kDefaultSpeculation) :
+      speculation_(speculation) {
+  }
+
+  ExecController(const ExecController&) = delete;
+  ExecController(ExecController&&) = delete;
+
+  ExecController& operator=(const ExecController&) = delete;
+  ExecController& operator=(ExecController&&) = delete;
+
+
+  // Requests an execution with the latest inputs.
+  void Request() {
+    ++stats_.requests;
+    if (pending_) ++stats_.dropped;
+    pending_ = true;
+  }
+
+  // Returns true when the pending request should be started now, and the
+  // request is consumed. While running, the process is aborted unless it's
+  // close to done, so the pending request can start soon.
+  bool Poll() {
+    if (!pending_) return false;
+    if (!running_) {
+      pending_ = false;
+      return true;
+    }
+    if (!aborting_ && proc_.busy() && proc_.progress() < speculation_) {
+      proc_.RequestAbort();
+      aborting_ = true;
+      ++stats_.aborted;
+    }
+    return false;
+  }
+
+  // Registers the process started for the request consumed by Poll().
+  void Start(iNode::ProcessRef&& proc) {
+    assert(!running_);
+    proc_     = std::move(proc);
+    running_  = true;
+    aborting_ = false;
+    ++stats_.runs;
+  }
+
+  // Must be called when the result of the running process is received, or
+  // the process is aborted.
+  void Done() {
+    running_ = false;
+  }
+
+  // Aborts the running process and drops the pending request.
+  void Abort() {
+    if (pending_) ++stats_.dropped;
+    pending_ = false;
+    if (proc_.busy()) proc_.RequestAbort();
+  }
+
+
+  void speculation(double v) {
+    speculation_ = v;
+  }
+  double speculation() const {
+    return speculation_;
+  }
+
+  bool pending() const {
+    return pending_;
+  }
+  bool running() const {
+    return running_;
+  }
+
+  const iNode::ProcessRef& proc() const {
+    return proc_;
+  }
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  double speculation_;
+
+  bool pending_  = false;
+  bool running_  = false;
+  bool aborting_ = false;
+
+  iNode::ProcessRef proc_;
+
+  Stats stats_;
+};
+
+}  // namespace mnian::core
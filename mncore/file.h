@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <filesystem>
 #include <memory>
 #include <mutex>  // NOLINT(build/c++11)
@@ -97,8 +98,11 @@ class iFile {
       assert(file_);
       return file_->Write(buf, n, offset);
     }
+    // Refuses to shrink the file under live mappings made by Map(), since
+    // accessing their pages beyond the new end raises SIGBUS.
     bool Truncate(size_t size) {
       assert(file_);
+      if (size < file_->GetMappedSize()) return false;
       return file_->Truncate(size);
     }
     bool Flush() {
@@ -109,6 +113,12 @@ class iFile {
       assert(file_);
       file_->Watch();
     }
+    std::shared_ptr<const std::byte> Map(size_t* size) {
+      assert(file_);
+      auto ret = file_->Map(size);
+      if (ret) file_->maps_.push_back({ret, *size});
+      return ret;
+    }
 
    private:
     iFile* file_;
@@ -165,15 +175,44 @@ class iFile {
   virtual bool Truncate(size_t size) = 0;
   virtual bool Flush() = 0;
 
+  // Maps whole contents into read-only memory and stores its size, or returns
+  // nullptr when it's unsupported. The memory is unmapped when the last
+  // reference is dropped, and is shared with the file so later writes might
+  // be visible through it. LockGuard refuses truncation under the mapping,
+  // but it can't stop other processes from truncating the file.
+  virtual std::shared_ptr<const std::byte> Map(size_t*) {
+    return nullptr;
+  }
+
   virtual std::filesystem::file_time_type GetLastModified() const = 0;
 
  private:
   const std::string url_;
 
+  struct Mapping final {
+   public:
+    std::weak_ptr<const std::byte> ptr;
+
+    size_t size;
+  };
+
+
+  // Returns the largest size of live mappings, dropping dead ones.
+  size_t GetMappedSize() {
+    std::erase_if(maps_, [](auto& m) { return m.ptr.expired(); });
+
+    size_t ret = 0;
+    for (auto& m : maps_) ret = std::max(ret, m.size);
+    return ret;
+  }
+
+
   std::vector<iFileObserver*> observers_;
 
   std::filesystem::file_time_type last_modified_;
 
+  std::vector<Mapping> maps_;
+
   std::mutex mutex_;
 };
 
@@ -5,6 +5,7 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -55,11 +56,30 @@ class UnixFile : public iFile {
     return actual_write > 0? static_cast<size_t>(actual_write): 0;
   }
   bool Truncate(size_t size) override {
-    return ftruncate(fd_, static_cast<off_t>(size));
+    return ftruncate(fd_, static_cast<off_t>(size)) == 0;
   }
   bool Flush() override {
     return fsync(fd_) == 0;
   }
+  std::shared_ptr<const std::byte> Map(size_t* size) override {
+    assert(size);
+
+    struct stat buf;
+    if (fstat(fd_, &buf) < 0 || buf.st_size <= 0) return nullptr;
+    const auto n = static_cast<size_t>(buf.st_size);
+
+    void* ptr = mmap(nullptr, n, PROT_READ, MAP_SHARED, fd_, 0);
+    if (ptr == MAP_FAILED) return nullptr;
+#if defined(MADV_WILLNEED)
+    // starts reading pages ahead, so the first access doesn't wait for them
+    madvise(ptr, n, MADV_WILLNEED);
+#endif
+
+    *size = n;
+    return std::shared_ptr<const std::byte>(
+        static_cast<const std::byte*>(ptr),
+        [n](const std::byte* p) { munmap(const_cast<std::byte*>(p), n); });
+  }
 
   std::filesystem::file_time_type GetLastModified() const override {
     struct stat buf;
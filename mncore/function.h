@@ -0,0 +1,128 @@
+// No copyright
+//
+// This file declares a callable wrapper that never allocates memory for small
+// captures.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "mncore/pool.h"
+
+
+namespace mnian::core {
+
+template <typename Sig, size_t N = 48>
+class SmallFunction;
+
+// SmallFunction is a move-only alternative of std::function. Callables whose
+// size is up to N bytes are stored in the inline buffer, and larger ones are
+// allocated from Pool, so the heap is never used for common closures.
+template <typename R, typename... Args, size_t N>
+class SmallFunction<R(Args...), N> final {
+ public:
+  SmallFunction() = default;
+  template <
+      typename F,
+      typename = std::enable_if_t<
+          !std::is_same_v<std::decay_t<F>, SmallFunction> &&
+          std::is_invocable_r_v<R, F&, Args...>>>
+  SmallFunction(F&& f) {  // NOLINT(runtime/explicit)
+    using T = std::decay_t<F>;
+    if constexpr (kInline<T>) {
+      new (buf_) T(std::forward<F>(f));
+    } else {
+      static_assert(alignof(T) <= Pool::kAlign);
+      auto ptr = static_cast<T*>(Pool::Allocate(sizeof(T)));
+      new (buf_) T*(new (ptr) T(std::forward<F>(f)));
+    }
+    vtable_ = &kVTable<T>;
+  }
+  ~SmallFunction() {
+    if (vtable_) vtable_->destroy(buf_);
+  }
+
+  SmallFunction(const SmallFunction&) = delete;
+  SmallFunction(SmallFunction&& src) : vtable_(src.vtable_) {
+    if (vtable_) vtable_->move(buf_, src.buf_);
+    src.vtable_ = nullptr;
+  }
+
+  SmallFunction& operator=(const SmallFunction&) = delete;
+  SmallFunction& operator=(SmallFunction&& src) {
+    if (this != &src) {
+      if (vtable_) vtable_->destroy(buf_);
+      vtable_ = src.vtable_;
+      if (vtable_) vtable_->move(buf_, src.buf_);
+      src.vtable_ = nullptr;
+    }
+    return *this;
+  }
+
+
+  R operator()(Args... args) {
+    assert(vtable_);
+    return vtable_->call(buf_, std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const {
+    return vtable_ != nullptr;
+  }
+
+ private:
+  struct VTable final {
+   public:
+    R    (*call)(void*, Args&&...);
+    void (*move)(void* dst, void* src);
+    void (*destroy)(void*);
+  };
+
+  template <typename T>
+  static constexpr bool kInline =
+      sizeof(T) <= N &&
+      alignof(T) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible_v<T>;
+
+  template <typename T>
+  static T& Get(void* buf) {
+    if constexpr (kInline<T>) {
+      return *std::launder(reinterpret_cast<T*>(buf));
+    } else {
+      return **std::launder(reinterpret_cast<T**>(buf));
+    }
+  }
+
+  template <typename T>
+  static constexpr VTable kVTable = {
+    .call = [](void* buf, Args&&... args) -> R {
+      return Get<T>(buf)(std::forward<Args>(args)...);
+    },
+    .move = [](void* dst, void* src) {
+      if constexpr (kInline<T>) {
+        new (dst) T(std::move(Get<T>(src)));
+        Get<T>(src).~T();
+      } else {
+        new (dst) T*(&Get<T>(src));
+      }
+    },
+    .destroy = [](void* buf) {
+      if constexpr (kInline<T>) {
+        Get<T>(buf).~T();
+      } else {
+        auto ptr = &Get<T>(buf);
+        ptr->~T();
+        Pool::Deallocate(ptr, sizeof(T));
+      }
+    },
+  };
+
+
+  alignas(std::max_align_t) std::byte buf_[N];
+
+  const VTable* vtable_ = nullptr;
+};
+
+}  // namespace mnian::core
@@ -0,0 +1,258 @@
+// No copyright
+#include "mncore/graph.h"
+
+#include <algorithm>
+
+#include "mncore/pool.h"
+
+
+namespace mnian::core {
+
+// Collector receives outputs of a node's lambda, and stores them to the graph.
+// It's also a child of collectors of upstream nodes, so it can see whether
+// they have been updated successfully.
+class NodeGraph::Collector final : public iLambda {
+ public:
+  Collector() = delete;
+  Collector(NodeGraph* g, iNode* node, uint64_t epoch) :
+      iLambda(node->outputCount(), 0), g_(g), node_(node), epoch_(epoch) {
+  }
+
+  Collector(const Collector&) = delete;
+  Collector(Collector&&) = delete;
+
+  Collector& operator=(const Collector&) = delete;
+  Collector& operator=(Collector&&) = delete;
+
+ protected:
+  void DoExec() override {
+    auto itr = g_->nodes_.find(node_);
+    if (itr == g_->nodes_.end()) return;  // removed while running
+    auto& st = itr->second;
+
+    for (size_t i = 0; i < st.out.size(); ++i) {
+      st.out[i].value = inRef(i);
+      ++st.out[i].version;
+    }
+
+    bool clean = st.epoch == epoch_;
+    for (auto& in : st.in) {
+      if (!in.src) continue;
+      in.seen = g_->nodes_.at(in.src).out[in.out].version;
+      clean   = clean && !g_->dirty_.contains(in.src);
+    }
+    if (clean) g_->dirty_.erase(node_);
+  }
+
+ private:
+  NodeGraph* g_;
+
+  iNode* node_;
+
+  uint64_t epoch_;
+};
+
+
+void NodeGraph::Add(iNode* node) {
+  assert(node);
+  assert(!nodes_.contains(node));
+
+  auto& st = nodes_[node];
+  st.in.resize(node->inputCount());
+  for (size_t i = 0; i < st.in.size(); ++i) {
+    st.in[i].value = iLambda::MakeValue(SharedAny(node->input(i).def()));
+  }
+  st.out.resize(node->outputCount());
+  st.observer = std::make_unique<Observer>(this, node);
+
+  dirty_.insert(node);
+}
+
+void NodeGraph::Remove(iNode* node) {
+  auto itr = nodes_.find(node);
+  if (itr == nodes_.end()) return;
+
+  auto& st = itr->second;
+  for (size_t i = 0; i < st.in.size(); ++i) {
+    if (st.in[i].src) Disconnect(node, i);
+  }
+  for (auto& out : st.out) {
+    for (const auto& dst : out.dst) {
+      nodes_.at(dst.first).in[dst.second].src = nullptr;
+      MarkDirty(dst.first);
+    }
+  }
+  dirty_.erase(node);
+  nodes_.erase(itr);
+}
+
+
+bool NodeGraph::Connect(iNode* src, size_t out, iNode* dst, size_t in) {
+  assert(nodes_.contains(src));
+  assert(nodes_.contains(dst));
+
+  if (Reaches(dst, src)) return false;
+
+  auto& input = nodes_.at(dst).in[in];
+  if (input.src) Disconnect(dst, in);
+
+  input.src  = src;
+  input.out  = out;
+  input.seen = 0;
+  nodes_.at(src).out[out].dst.emplace_back(dst, in);
+
+  MarkDirty(dst);
+  return true;
+}
+
+void NodeGraph::Disconnect(iNode* dst, size_t in) {
+  auto& input = nodes_.at(dst).in[in];
+  if (!input.src) return;
+
+  auto& links = nodes_.at(input.src).out[input.out].dst;
+  links.erase(
+      std::remove(links.begin(), links.end(), std::make_pair(dst, in)),
+      links.end());
+  input.src = nullptr;
+
+  MarkDirty(dst);
+}
+
+void NodeGraph::SetInput(iNode* node, size_t in, SharedAny&& value) {
+  Disconnect(node, in);
+  nodes_.at(node).in[in].value = iLambda::MakeValue(std::move(value));
+  MarkDirty(node);
+}
+
+void NodeGraph::MarkDirty(iNode* node) {
+  std::vector<iNode*> stack = {node};
+  while (stack.size()) {
+    auto n = stack.back();
+    stack.pop_back();
+
+    auto& st = nodes_.at(n);
+    ++st.epoch;
+    if (!dirty_.insert(n).second) continue;
+
+    for (const auto& out : st.out) {
+      for (const auto& dst : out.dst) stack.push_back(dst.first);
+    }
+  }
+}
+
+
+std::shared_ptr<iTask> NodeGraph::Run(TaskQueue* q) {
+  assert(!busy());
+  procs_.clear();
+
+  auto join = MakePooled<Task>([]() { });
+  q->Attach(join);
+
+  struct Pair {
+   public:
+    std::shared_ptr<iLambda>   lambda;
+    std::shared_ptr<Collector> collector;
+  };
+  std::unordered_map<iNode*, Pair> tasks;
+
+  for (auto node : SortDirty()) {
+    const auto& st = nodes_.at(node);
+
+    auto proc      = node->EnqueueLambda(iNode::kFull);
+    auto lambda    = proc.lambda();
+    auto collector = MakePooled<Collector>(this, node, st.epoch);
+
+    // Inputs from dirty nodes are passed through connections, and others
+    // take the last values.
+    for (size_t i = 0; i < st.in.size(); ++i) {
+      const auto& in   = st.in[i];
+      const auto  port = node->input(i).index();
+      if (!in.src) {
+        lambda->in(port, Value(in.value));
+        continue;
+      }
+
+      auto itr = tasks.find(in.src);
+      if (itr != tasks.end()) {
+        const auto& up = itr->second;
+        up.lambda->Connect(in.src->output(in.out).index(), lambda, port);
+        up.collector->AddChild(collector);
+      } else {
+        lambda->in(port, Value(nodes_.at(in.src).out[in.out].value));
+      }
+    }
+    for (size_t i = 0; i < st.out.size(); ++i) {
+      lambda->Connect(node->output(i).index(), collector, i);
+    }
+    // Nodes without outputs also have to be collected after the execution.
+    lambda->AddChild(collector);
+
+    collector->AddChild(join);
+    q->Attach(collector);
+
+    tasks[node] = {lambda, collector};
+    procs_.push_back(std::move(proc));
+  }
+
+  for (auto& p : tasks) {
+    p.second.lambda->Trigger();
+    p.second.collector->Trigger();
+  }
+  join->Trigger();
+
+  join_ = join;
+  return join;
+}
+
+void NodeGraph::Abort() {
+  for (auto& proc : procs_) {
+    if (proc.busy()) proc.RequestAbort();
+  }
+}
+
+
+bool NodeGraph::Reaches(iNode* from, iNode* to) const {
+  std::unordered_set<iNode*> visited;
+
+  std::vector<iNode*> stack = {from};
+  while (stack.size()) {
+    auto n = stack.back();
+    stack.pop_back();
+
+    if (n == to) return true;
+    if (!visited.insert(n).second) continue;
+
+    for (const auto& out : nodes_.at(n).out) {
+      for (const auto& dst : out.dst) stack.push_back(dst.first);
+    }
+  }
+  return false;
+}
+
+std::vector<iNode*> NodeGraph::SortDirty() const {
+  // Kahn's algorithm on the subgraph of dirty nodes
+  std::unordered_map<iNode*, size_t> indeg;
+  for (auto n : dirty_) indeg[n];
+  for (auto n : dirty_) {
+    for (const auto& out : nodes_.at(n).out) {
+      for (const auto& dst : out.dst) ++indeg[dst.first];
+    }
+  }
+
+  std::vector<iNode*> ret;
+  ret.reserve(dirty_.size());
+  for (const auto& p : indeg) {
+    if (p.second == 0) ret.push_back(p.first);
+  }
+  for (size_t i = 0; i < ret.size(); ++i) {
+    for (const auto& out : nodes_.at(ret[i]).out) {
+      for (const auto& dst : out.dst) {
+        if (--indeg[dst.first] == 0) ret.push_back(dst.first);
+      }
+    }
+  }
+  assert(ret.size() == dirty_.size());
+  return ret;
+}
+
+}  // namespace mnian::core
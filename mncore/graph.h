@@ -0,0 +1,179 @@
+// No copyright
+//
+// This file declares a graph of nodes connected socket to socket, which
+// re-executes only nodes affected by changes.
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "mncore/conv.h"
+#include "mncore/node.h"
+#include "mncore/task.h"
+
+
+namespace mnian::core {
+
+// NodeGraph holds a dirty flag of each node and a version of each output
+// socket. Changing an input or a parameter marks the node and all of its
+// descendants dirty, and Run() executes only dirty nodes while others pass
+// their last outputs. So the cost of an edit is proportional to the cone
+// affected by it.
+//
+// This is not thread-safe. Tasks which update the graph with results are
+// executed on the queue passed to Run(), which should be drained by the thread
+// owning the graph.
+class NodeGraph final {
+ public:
+  using Value   = iLambda::Value;
+  using Version = uint64_t;
+
+
+  NodeGraph() = default;
+
+  NodeGraph(const NodeGraph&) = delete;
+  NodeGraph(NodeGraph&&) = delete;
+
+  NodeGraph& operator=(const NodeGraph&) = delete;
+  NodeGraph& operator=(NodeGraph&&) = delete;
+
+
+  // The node must be removed before deleted, otherwise it's removed
+  // automatically when deleted. Added node is dirty and its inputs are
+  // defaults of sockets.
+  void Add(iNode* node);
+  void Remove(iNode* node);
+
+  // Connects an output socket to an input socket. Returns false and does
+  // nothing when it makes a cycle.
+  bool Connect(iNode* src, size_t out, iNode* dst, size_t in);
+  void Disconnect(iNode* dst, size_t in);
+
+  // Sets a constant value to the input socket, and disconnects it.
+  void SetInput(iNode* node, size_t in, SharedAny&& value);
+
+  // Marks the node and all of its descendants dirty. This stops at nodes
+  // already dirty, whose descendants are also dirty.
+  void MarkDirty(iNode* node);
+
+  // Executes all dirty nodes by their lambdas, and returns a task which is
+  // done when all of them are done. A node remains dirty if its execution is
+  // aborted, or marked dirty again while running.
+  std::shared_ptr<iTask> Run(TaskQueue* q);
+
+  // Aborts all processes started by the last Run().
+  void Abort();
+
+
+  bool busy() const {
+    return join_ && join_->state() != iTask::kDone;
+  }
+
+  bool contains(iNode* node) const {
+    return nodes_.contains(node);
+  }
+  bool dirty(iNode* node) const {
+    return dirty_.contains(node);
+  }
+  size_t dirtyCount() const {
+    return dirty_.size();
+  }
+
+  // Returns the last output, which is null if the node has never been done.
+  const Value& output(iNode* node, size_t i) const {
+    return nodes_.at(node).out[i].value;
+  }
+  // Returns a number of times the output has been updated.
+  Version version(iNode* node, size_t i) const {
+    return nodes_.at(node).out[i].version;
+  }
+  // Returns a version of the connected output that the input has consumed.
+  Version seen(iNode* node, size_t i) const {
+    return nodes_.at(node).in[i].seen;
+  }
+
+ private:
+  class Collector;
+
+  class Observer final : public iNodeObserver {
+   public:
+    Observer() = delete;
+    Observer(NodeGraph* g, iNode* node) :
+        iNodeObserver(node), g_(g), node_(node) {
+    }
+
+    Observer(const Observer&) = delete;
+    Observer(Observer&&) = delete;
+
+    Observer& operator=(const Observer&) = delete;
+    Observer& operator=(Observer&&) = delete;
+
+
+    void ObserveDelete() override {
+      g_->Remove(node_);
+    }
+    void ObserveUpdate() override {
+      g_->MarkDirty(node_);
+    }
+
+   private:
+    NodeGraph* g_;
+
+    // target() is not available in ObserveDelete()
+    iNode* node_;
+  };
+
+
+  struct Input final {
+   public:
+    iNode* src = nullptr;
+    size_t out = 0;
+
+    // a constant value used when not connected
+    Value value;
+
+    Version seen = 0;
+  };
+  struct Output final {
+   public:
+    Value value;
+
+    Version version = 0;
+
+    // pairs of connected node and index of its input
+    std::vector<std::pair<iNode*, size_t>> dst;
+  };
+  struct NodeState final {
+   public:
+    std::vector<Input>  in;
+    std::vector<Output> out;
+
+    // incremented whenever the node is marked dirty
+    uint64_t epoch = 0;
+
+    std::unique_ptr<Observer> observer;
+  };
+
+
+  // Returns true if `to` is reachable from `from` through edges.
+  bool Reaches(iNode* from, iNode* to) const;
+
+  // Returns dirty nodes in topological order.
+  std::vector<iNode*> SortDirty() const;
+
+
+  std::unordered_map<iNode*, NodeState> nodes_;
+
+  std::unordered_set<iNode*> dirty_;
+
+  std::vector<iNode::ProcessRef> procs_;
+
+  std::shared_ptr<iTask> join_;
+};
+
+}  // namespace mnian::core
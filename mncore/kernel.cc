@@ -0,0 +1,179 @@
+// No copyright
+#include "mncore/kernel.h"
+
+#include <cmath>
+
+#include "mncore/kernel_impl.h"
+
+#if defined(MNCORE_KERNEL_X86)
+# if defined(_MSC_VER)
+#   include <intrin.h>
+# else
+#   include <cpuid.h>
+# endif
+#endif
+
+
+namespace mnian::core {
+
+namespace {
+
+class ScalarOps final {
+ public:
+  using V = float;
+
+  static constexpr size_t kN = 1;
+
+
+  static V Load(const float* p) {
+    return *p;
+  }
+  static void Store(float* p, V v) {
+    *p = v;
+  }
+  static V Set1(float v) {
+    return v;
+  }
+
+  static V Add(V a, V b) {
+    return a+b;
+  }
+  static V Sub(V a, V b) {
+    return a-b;
+  }
+  static V Mul(V a, V b) {
+    return a*b;
+  }
+  static V Fma(V a, V b, V c) {
+    return a*b+c;
+  }
+  static V Min(V a, V b) {
+    return a < b? a: b;
+  }
+  static V Max(V a, V b) {
+    return a > b? a: b;
+  }
+
+  static float ReduceAdd(V v) {
+    return v;
+  }
+  static float ReduceMin(V v) {
+    return v;
+  }
+  static float ReduceMax(V v) {
+    return v;
+  }
+
+  static void CvtF32ToF64(double* out, const float* in) {
+    *out = *in;
+  }
+  static void CvtF64ToF32(float* out, const double* in) {
+    *out = static_cast<float>(*in);
+  }
+  static void CvtI32ToF32(float* out, const int32_t* in) {
+    *out = static_cast<float>(*in);
+  }
+  static void CvtU8ToF32(float* out, const uint8_t* in) {
+    *out = *in;
+  }
+  static void StoreU8(uint8_t* out, V v) {
+    *out = static_cast<uint8_t>(std::nearbyint(v));
+  }
+};
+
+#if defined(MNCORE_KERNEL_X86)
+void Cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4]) {
+# if defined(_MSC_VER)
+  int x[4];
+  __cpuidex(x, static_cast<int>(leaf), static_cast<int>(sub));
+  for (size_t i = 0; i < 4; ++i) r[i] = static_cast<uint32_t>(x[i]);
+# else
+  __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+# endif
+}
+
+// Returns XCR0, which tells which registers are saved by the OS.
+uint64_t Xgetbv() {
+# if defined(_MSC_VER)
+  return _xgetbv(0);
+# else
+  uint32_t lo, hi;
+  __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (uint64_t{hi} << 32) | lo;
+# endif
+}
+#endif
+
+}  // namespace
+
+
+constinit const Kernel::Table Kernel::kScalarTable =
+    KernelImpl<ScalarOps>::MakeTable();
+
+
+const char* Kernel::StringifyIsa(Isa isa) {
+  switch (isa) {
+  case kScalar:
+    return "scalar";
+  case kSse2:
+    return "sse2";
+  case kAvx2:
+    return "avx2";
+  case kAvx512:
+    return "avx512";
+  }
+  assert(false);
+  return "";
+}
+
+Kernel::Isa Kernel::DetectIsa() {
+#if defined(MNCORE_KERNEL_X86)
+  static const Isa ret = []() {
+    uint32_t r[4];
+    Cpuid(0, 0, r);
+    const uint32_t max_leaf = r[0];
+
+    Cpuid(1, 0, r);
+    const bool osxsave = r[2] & (1u << 27);
+    const bool avx     = r[2] & (1u << 28);
+    const bool fma     = r[2] & (1u << 12);
+    if (!osxsave || !avx || max_leaf < 7) return kSse2;
+
+    // The OS must save YMM registers for AVX2, and also ZMM and opmask
+    // registers for AVX-512.
+    const auto xcr0 = Xgetbv();
+    if ((xcr0 & 0x06) != 0x06) return kSse2;
+
+    Cpuid(7, 0, r);
+    const bool avx2    = r[1] & (1u << 5);
+    const bool avx512f = r[1] & (1u << 16);
+    if (!avx2 || !fma) return kSse2;
+    if (!avx512f || (xcr0 & 0xE6) != 0xE6) return kAvx2;
+    return kAvx512;
+  }();
+  return ret;
+#else
+  return kScalar;
+#endif
+}
+
+const Kernel::Table* Kernel::GetTable(Isa isa) {
+  if (isa > DetectIsa()) return nullptr;
+
+  switch (isa) {
+  case kScalar:
+    return &kScalarTable;
+#if defined(MNCORE_KERNEL_X86)
+  case kSse2:
+    return &kSse2Table;
+  case kAvx2:
+    return &kAvx2Table;
+  case kAvx512:
+    return &kAvx512Table;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+}  // namespace mnian::core
@@ -0,0 +1,185 @@
+// No copyright
+//
+// This file declares elementwise kernels over contiguous spans of numbers,
+// which are vectorized and dispatched at runtime by CPU features.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define MNCORE_KERNEL_X86
+#endif
+
+
+namespace mnian::core {
+
+// Kernel is a set of functions implemented for an instruction set. The default
+// one uses the best instruction set supported by both the build and the
+// running CPU. Results of floating-point operations can differ slightly
+// between instruction sets, because of FMA and the order of reductions.
+//
+// Output spans can be the same as input spans, but must not partially overlap.
+//
+// ## Example
+// ```
+// static const core::Kernel k;
+// k.Lerp(a, b, .5f, out);
+// const float sum = k.Sum(out);
+// ```
+class Kernel final {
+ public:
+  enum Isa {
+    kScalar,
+    kSse2,
+    kAvx2,
+    kAvx512,
+  };
+
+  struct Table final {
+   public:
+    void (*add)(const float*, const float*, float*, size_t);
+    void (*mul)(const float*, const float*, float*, size_t);
+    void (*fma)(const float*, const float*, const float*, float*, size_t);
+    void (*clamp)(const float*, float, float, float*, size_t);
+    void (*lerp)(const float*, const float*, float, float*, size_t);
+
+    void (*f32_to_f64)(const float*, double*, size_t);
+    void (*f64_to_f32)(const double*, float*, size_t);
+    void (*i32_to_f32)(const int32_t*, float*, size_t);
+    void (*u8_to_f32)(const uint8_t*, float*, size_t);
+    void (*f32_to_u8)(const float*, uint8_t*, size_t);
+
+    float (*sum)(const float*, size_t);
+    float (*min)(const float*, size_t);
+    float (*max)(const float*, size_t);
+    float (*dot)(const float*, const float*, size_t);
+  };
+
+
+  static const char* StringifyIsa(Isa isa);
+
+  // Returns the best instruction set supported by both the build and the
+  // running CPU, checked by CPUID.
+  static Isa DetectIsa();
+
+  // Returns nullptr if the instruction set is not available.
+  static const Table* GetTable(Isa isa);
+
+
+  explicit Kernel(Isa isa = DetectIsa()) : isa_(isa), t_(GetTable(isa)) {
+    assert(t_);
+  }
+
+  Kernel(const Kernel&) = default;
+  Kernel(Kernel&&) = default;
+
+  Kernel& operator=(const Kernel&) = default;
+  Kernel& operator=(Kernel&&) = default;
+
+
+  // out = a+b
+  void Add(std::span<const float> a,
+           std::span<const float> b,
+           std::span<float>       out) const {
+    assert(a.size() == out.size() && b.size() == out.size());
+    t_->add(a.data(), b.data(), out.data(), out.size());
+  }
+  // out = a*b
+  void Mul(std::span<const float> a,
+           std::span<const float> b,
+           std::span<float>       out) const {
+    assert(a.size() == out.size() && b.size() == out.size());
+    t_->mul(a.data(), b.data(), out.data(), out.size());
+  }
+  // out = a*b+c
+  void Fma(std::span<const float> a,
+           std::span<const float> b,
+           std::span<const float> c,
+           std::span<float>       out) const {
+    assert(a.size() == out.size() && b.size() == out.size());
+    assert(c.size() == out.size());
+    t_->fma(a.data(), b.data(), c.data(), out.data(), out.size());
+  }
+  // out = min(max(a, lo), hi), where NaN becomes lo
+  void Clamp(std::span<const float> a,
+             float                  lo,
+             float                  hi,
+             std::span<float>       out) const {
+    assert(a.size() == out.size());
+    t_->clamp(a.data(), lo, hi, out.data(), out.size());
+  }
+  // out = a+(b-a)*t
+  void Lerp(std::span<const float> a,
+            std::span<const float> b,
+            float                  t,
+            std::span<float>       out) const {
+    assert(a.size() == out.size() && b.size() == out.size());
+    t_->lerp(a.data(), b.data(), t, out.data(), out.size());
+  }
+
+
+  void Convert(std::span<const float> in, std::span<double> out) const {
+    assert(in.size() == out.size());
+    t_->f32_to_f64(in.data(), out.data(), out.size());
+  }
+  void Convert(std::span<const double> in, std::span<float> out) const {
+    assert(in.size() == out.size());
+    t_->f64_to_f32(in.data(), out.data(), out.size());
+  }
+  void Convert(std::span<const int32_t> in, std::span<float> out) const {
+    assert(in.size() == out.size());
+    t_->i32_to_f32(in.data(), out.data(), out.size());
+  }
+  void Convert(std::span<const uint8_t> in, std::span<float> out) const {
+    assert(in.size() == out.size());
+    t_->u8_to_f32(in.data(), out.data(), out.size());
+  }
+  // Rounds to nearest even, and saturates into [0, 255]. NaN becomes 0.
+  void Convert(std::span<const float> in, std::span<uint8_t> out) const {
+    assert(in.size() == out.size());
+    t_->f32_to_u8(in.data(), out.data(), out.size());
+  }
+
+
+  // Results of reductions are unspecified if the span contains NaN.
+  float Sum(std::span<const float> a) const {
+    return t_->sum(a.data(), a.size());
+  }
+  // Returns +inf if empty.
+  float Min(std::span<const float> a) const {
+    return t_->min(a.data(), a.size());
+  }
+  // Returns -inf if empty.
+  float Max(std::span<const float> a) const {
+    return t_->max(a.data(), a.size());
+  }
+  float Dot(std::span<const float> a, std::span<const float> b) const {
+    assert(a.size() == b.size());
+    return t_->dot(a.data(), b.data(), a.size());
+  }
+
+
+  Isa isa() const {
+    return isa_;
+  }
+
+ private:
+  // Each of them is defined in kernel_*.cc.
+  static const Table kScalarTable;
+#if defined(MNCORE_KERNEL_X86)
+  static const Table kSse2Table;
+  static const Table kAvx2Table;
+  static const Table kAvx512Table;
+#endif
+
+
+  Isa isa_;
+
+  const Table* t_;
+};
+
+}  // namespace mnian::core
@@ -0,0 +1,107 @@
+// No copyright
+//
+// This file is compiled with AVX2 and FMA, and used only when the CPU
+// supports them.
+#include "mncore/kernel.h"
+
+#if defined(MNCORE_KERNEL_X86)
+
+#include <immintrin.h>
+
+#include "mncore/kernel_impl.h"
+
+
+namespace mnian::core {
+
+namespace {
+
+class Avx2Ops final {
+ public:
+  using V = __m256;
+
+  static constexpr size_t kN = 8;
+
+
+  static V Load(const float* p) {
+    return _mm256_loadu_ps(p);
+  }
+  static void Store(float* p, V v) {
+    _mm256_storeu_ps(p, v);
+  }
+  static V Set1(float v) {
+    return _mm256_set1_ps(v);
+  }
+
+  static V Add(V a, V b) {
+    return _mm256_add_ps(a, b);
+  }
+  static V Sub(V a, V b) {
+    return _mm256_sub_ps(a, b);
+  }
+  static V Mul(V a, V b) {
+    return _mm256_mul_ps(a, b);
+  }
+  static V Fma(V a, V b, V c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  static V Min(V a, V b) {
+    return _mm256_min_ps(a, b);
+  }
+  static V Max(V a, V b) {
+    return _mm256_max_ps(a, b);
+  }
+
+  static float ReduceAdd(V v) {
+    auto x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+  }
+  static float ReduceMin(V v) {
+    auto x = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_min_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+  }
+  static float ReduceMax(V v) {
+    auto x = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_max_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+  }
+
+  static void CvtF32ToF64(double* out, const float* in) {
+    _mm256_storeu_pd(out,   _mm256_cvtps_pd(_mm_loadu_ps(in)));
+    _mm256_storeu_pd(out+4, _mm256_cvtps_pd(_mm_loadu_ps(in+4)));
+  }
+  static void CvtF64ToF32(float* out, const double* in) {
+    _mm_storeu_ps(out,   _mm256_cvtpd_ps(_mm256_loadu_pd(in)));
+    _mm_storeu_ps(out+4, _mm256_cvtpd_ps(_mm256_loadu_pd(in+4)));
+  }
+  static void CvtI32ToF32(float* out, const int32_t* in) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    _mm256_storeu_ps(out, _mm256_cvtepi32_ps(v));
+  }
+  static void CvtU8ToF32(float* out, const uint8_t* in) {
+    const auto v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+    _mm256_storeu_ps(out, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)));
+  }
+  static void StoreU8(uint8_t* out, V v) {
+    const auto i = _mm256_cvtps_epi32(v);
+
+    auto x = _mm_packs_epi32(
+        _mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+    x = _mm_packus_epi16(x, x);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), x);
+  }
+};
+
+}  // namespace
+
+
+constinit const Kernel::Table Kernel::kAvx2Table =
+    KernelImpl<Avx2Ops>::MakeTable();
+
+}  // namespace mnian::core
+
+#endif
@@ -0,0 +1,99 @@
+// No copyright
+//
+// This file is compiled with AVX-512F, and used only when the CPU supports it.
+#include "mncore/kernel.h"
+
+#if defined(MNCORE_KERNEL_X86)
+
+// GCC 12 warns about _mm512_undefined_*() used inside intrinsics.
+// https://gcc.gnu.org/bugzilla/show_bug.cgi?id=105593
+#if defined(__GNUC__) && !defined(__clang__)
+# pragma GCC diagnostic ignored "-Wuninitialized"
+# pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include <immintrin.h>
+
+#include "mncore/kernel_impl.h"
+
+
+namespace mnian::core {
+
+namespace {
+
+class Avx512Ops final {
+ public:
+  using V = __m512;
+
+  static constexpr size_t kN = 16;
+
+
+  static V Load(const float* p) {
+    return _mm512_loadu_ps(p);
+  }
+  static void Store(float* p, V v) {
+    _mm512_storeu_ps(p, v);
+  }
+  static V Set1(float v) {
+    return _mm512_set1_ps(v);
+  }
+
+  static V Add(V a, V b) {
+    return _mm512_add_ps(a, b);
+  }
+  static V Sub(V a, V b) {
+    return _mm512_sub_ps(a, b);
+  }
+  static V Mul(V a, V b) {
+    return _mm512_mul_ps(a, b);
+  }
+  static V Fma(V a, V b, V c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  static V Min(V a, V b) {
+    return _mm512_min_ps(a, b);
+  }
+  static V Max(V a, V b) {
+    return _mm512_max_ps(a, b);
+  }
+
+  static float ReduceAdd(V v) {
+    return _mm512_reduce_add_ps(v);
+  }
+  static float ReduceMin(V v) {
+    return _mm512_reduce_min_ps(v);
+  }
+  static float ReduceMax(V v) {
+    return _mm512_reduce_max_ps(v);
+  }
+
+  static void CvtF32ToF64(double* out, const float* in) {
+    _mm512_storeu_pd(out,   _mm512_cvtps_pd(_mm256_loadu_ps(in)));
+    _mm512_storeu_pd(out+8, _mm512_cvtps_pd(_mm256_loadu_ps(in+8)));
+  }
+  static void CvtF64ToF32(float* out, const double* in) {
+    _mm256_storeu_ps(out,   _mm512_cvtpd_ps(_mm512_loadu_pd(in)));
+    _mm256_storeu_ps(out+8, _mm512_cvtpd_ps(_mm512_loadu_pd(in+8)));
+  }
+  static void CvtI32ToF32(float* out, const int32_t* in) {
+    _mm512_storeu_ps(out, _mm512_cvtepi32_ps(_mm512_loadu_si512(in)));
+  }
+  static void CvtU8ToF32(float* out, const uint8_t* in) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    _mm512_storeu_ps(out, _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(v)));
+  }
+  static void StoreU8(uint8_t* out, V v) {
+    const auto i = _mm512_cvtusepi32_epi8(_mm512_cvtps_epu32(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), i);
+  }
+};
+
+}  // namespace
+
+
+constinit const Kernel::Table Kernel::kAvx512Table =
+    KernelImpl<Avx512Ops>::MakeTable();
+
+}  // namespace mnian::core
+
+#endif
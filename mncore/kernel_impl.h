@@ -0,0 +1,170 @@
+// No copyright
+//
+// This file defines kernels generically over operations of a vector register,
+// and is included only by kernel_*.cc.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "mncore/kernel.h"
+
+
+namespace mnian::core {
+
+// Kernels process kN elements at once by O, which provides:
+//
+// - `V`, a vector type of kN floats
+// - Load/Store/Set1/Add/Sub/Mul/Fma
+// - Min(a, b) as a < b? a: b, and Max(a, b) as a > b? a: b
+// - ReduceAdd/ReduceMin/ReduceMax, which fold lanes into a float
+// - Cvt*(out, in), which converts kN elements from memory to memory
+// - StoreU8(), which rounds kN floats in [0, 255] into uint8_t
+//
+// The last partial block is processed through padded buffers, so that every
+// element goes through the same instructions regardless of its position.
+//
+// Each kernel_*.cc must instantiate this with O declared in an anonymous
+// namespace, and O must not call inline functions of other headers, because
+// they are compiled with different instruction sets and the linker could
+// pick any of their copies.
+template <typename O>
+class KernelImpl final {
+ public:
+  using V = typename O::V;
+
+  static constexpr size_t kN = O::kN;
+
+  KernelImpl() = delete;
+
+
+  static constexpr Kernel::Table MakeTable() {
+    return {
+      .add   = Add,
+      .mul   = Mul,
+      .fma   = Fma,
+      .clamp = Clamp,
+      .lerp  = Lerp,
+
+      .f32_to_f64 = Cvt<float, double, O::CvtF32ToF64>,
+      .f64_to_f32 = Cvt<double, float, O::CvtF64ToF32>,
+      .i32_to_f32 = Cvt<int32_t, float, O::CvtI32ToF32>,
+      .u8_to_f32  = Cvt<uint8_t, float, O::CvtU8ToF32>,
+      .f32_to_u8  = F32ToU8,
+
+      .sum = Sum,
+      .min = Min,
+      .max = Max,
+      .dot = Dot,
+    };
+  }
+
+ private:
+  // Calls f(out+i, a+i, b+i, ...) for each block.
+  template <typename Out, typename F, typename... In>
+  static void Map(F f, Out* out, size_t n, const In*... in) {
+    size_t i = 0;
+    for (; i+kN <= n; i += kN) f(out+i, (in+i)...);
+    if (i == n) return;
+
+    Out tout[kN] = {};
+    f(tout, Pad(in+i, n-i)...);
+    for (size_t j = 0; i+j < n; ++j) out[i+j] = tout[j];
+  }
+
+  // Returns a fold of all elements by f(acc, a+i, b+i, ...), where a lacking
+  // element is filled by the pad.
+  template <typename F, typename... In>
+  static V Fold(F f, V acc, float pad, size_t n, const In*... in) {
+    size_t i = 0;
+    for (; i+kN <= n; i += kN) acc = f(acc, (in+i)...);
+    if (i == n) return acc;
+    return f(acc, Pad(in+i, n-i, pad)...);
+  }
+
+  // Copies n (< kN) elements to a buffer padded by v. The buffer is a
+  // temporary, which lives until the end of the caller's full expression.
+  template <typename T>
+  struct Buffer final {
+   public:
+    T data[kN];
+  };
+  template <typename T>
+  static const T* Pad(const T* p, size_t n, T v = T{0}, Buffer<T>&& b = {}) {
+    for (size_t j = 0; j < kN; ++j) b.data[j] = j < n? p[j]: v;
+    return b.data;
+  }
+
+
+  static void Add(const float* a, const float* b, float* out, size_t n) {
+    Map([](float* out, const float* a, const float* b) {
+          O::Store(out, O::Add(O::Load(a), O::Load(b)));
+        }, out, n, a, b);
+  }
+  static void Mul(const float* a, const float* b, float* out, size_t n) {
+    Map([](float* out, const float* a, const float* b) {
+          O::Store(out, O::Mul(O::Load(a), O::Load(b)));
+        }, out, n, a, b);
+  }
+  static void Fma(const float* a, const float* b, const float* c,
+                  float* out, size_t n) {
+    Map([](float* out, const float* a, const float* b, const float* c) {
+          O::Store(out, O::Fma(O::Load(a), O::Load(b), O::Load(c)));
+        }, out, n, a, b, c);
+  }
+  static void Clamp(const float* a, float lo, float hi, float* out, size_t n) {
+    const V vlo = O::Set1(lo), vhi = O::Set1(hi);
+    Map([vlo, vhi](float* out, const float* a) {
+          O::Store(out, O::Min(O::Max(O::Load(a), vlo), vhi));
+        }, out, n, a);
+  }
+  static void Lerp(const float* a, const float* b, float t,
+                   float* out, size_t n) {
+    const V vt = O::Set1(t);
+    Map([vt](float* out, const float* a, const float* b) {
+          const V va = O::Load(a);
+          O::Store(out, O::Fma(O::Sub(O::Load(b), va), vt, va));
+        }, out, n, a, b);
+  }
+
+  template <typename In, typename Out, void (*kCvt)(Out*, const In*)>
+  static void Cvt(const In* in, Out* out, size_t n) {
+    Map(kCvt, out, n, in);
+  }
+  static void F32ToU8(const float* in, uint8_t* out, size_t n) {
+    const V zero = O::Set1(0), max = O::Set1(255);
+    Map([zero, max](uint8_t* out, const float* in) {
+          O::StoreU8(out, O::Min(O::Max(O::Load(in), zero), max));
+        }, out, n, in);
+  }
+
+  static float Sum(const float* a, size_t n) {
+    const auto f = [](V acc, const float* a) {
+      return O::Add(acc, O::Load(a));
+    };
+    return O::ReduceAdd(Fold(f, O::Set1(0), 0, n, a));
+  }
+  static float Min(const float* a, size_t n) {
+    const auto f = [](V acc, const float* a) {
+      return O::Min(acc, O::Load(a));
+    };
+    constexpr float kInf = std::numeric_limits<float>::infinity();
+    return O::ReduceMin(Fold(f, O::Set1(kInf), kInf, n, a));
+  }
+  static float Max(const float* a, size_t n) {
+    const auto f = [](V acc, const float* a) {
+      return O::Max(acc, O::Load(a));
+    };
+    constexpr float kInf = std::numeric_limits<float>::infinity();
+    return O::ReduceMax(Fold(f, O::Set1(-kInf), -kInf, n, a));
+  }
+  static float Dot(const float* a, const float* b, size_t n) {
+    const auto f = [](V acc, const float* a, const float* b) {
+      return O::Fma(O::Load(a), O::Load(b), acc);
+    };
+    return O::ReduceAdd(Fold(f, O::Set1(0), 0, n, a, b));
+  }
+};
+
+}  // namespace mnian::core
@@ -0,0 +1,107 @@
+// No copyright
+//
+// This file is compiled with SSE2, which every x86-64 CPU supports.
+#include "mncore/kernel.h"
+
+#if defined(MNCORE_KERNEL_X86)
+
+#include <emmintrin.h>
+
+#include "mncore/kernel_impl.h"
+
+
+namespace mnian::core {
+
+namespace {
+
+class Sse2Ops final {
+ public:
+  using V = __m128;
+
+  static constexpr size_t kN = 4;
+
+
+  static V Load(const float* p) {
+    return _mm_loadu_ps(p);
+  }
+  static void Store(float* p, V v) {
+    _mm_storeu_ps(p, v);
+  }
+  static V Set1(float v) {
+    return _mm_set1_ps(v);
+  }
+
+  static V Add(V a, V b) {
+    return _mm_add_ps(a, b);
+  }
+  static V Sub(V a, V b) {
+    return _mm_sub_ps(a, b);
+  }
+  static V Mul(V a, V b) {
+    return _mm_mul_ps(a, b);
+  }
+  static V Fma(V a, V b, V c) {
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  static V Min(V a, V b) {
+    return _mm_min_ps(a, b);
+  }
+  static V Max(V a, V b) {
+    return _mm_max_ps(a, b);
+  }
+
+  static float ReduceAdd(V v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+  }
+  static float ReduceMin(V v) {
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+  }
+  static float ReduceMax(V v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+  }
+
+  static void CvtF32ToF64(double* out, const float* in) {
+    const V v = _mm_loadu_ps(in);
+    _mm_storeu_pd(out,   _mm_cvtps_pd(v));
+    _mm_storeu_pd(out+2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+  }
+  static void CvtF64ToF32(float* out, const double* in) {
+    const V lo = _mm_cvtpd_ps(_mm_loadu_pd(in));
+    const V hi = _mm_cvtpd_ps(_mm_loadu_pd(in+2));
+    _mm_storeu_ps(out, _mm_movelh_ps(lo, hi));
+  }
+  static void CvtI32ToF32(float* out, const int32_t* in) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    _mm_storeu_ps(out, _mm_cvtepi32_ps(v));
+  }
+  static void CvtU8ToF32(float* out, const uint8_t* in) {
+    const auto zero = _mm_setzero_si128();
+
+    auto v = _mm_loadu_si32(in);
+    v = _mm_unpacklo_epi8(v, zero);
+    v = _mm_unpacklo_epi16(v, zero);
+    _mm_storeu_ps(out, _mm_cvtepi32_ps(v));
+  }
+  static void StoreU8(uint8_t* out, V v) {
+    auto i = _mm_cvtps_epi32(v);
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    _mm_storeu_si32(out, i);
+  }
+};
+
+}  // namespace
+
+
+constinit const Kernel::Table Kernel::kSse2Table =
+    KernelImpl<Sse2Ops>::MakeTable();
+
+}  // namespace mnian::core
+
+#endif
@@ -0,0 +1,216 @@
+// No copyright
+#include "mncore/memo.h"
+
+#include <cassert>
+#include <cstring>
+#include <utility>
+#include <variant>
+
+
+namespace mnian::core {
+
+void Hasher::SerializeValue(const Any& value) {
+  Add(value.index());
+  std::visit(
+      [this](auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same<T, std::string>::value) {
+          AddString(v);
+        } else {
+          Add(v);
+        }
+      },
+      value);
+}
+
+void Hasher::AddValue(const SharedAny& value) {
+  Add(value.index());
+  std::visit(
+      [this](auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same<T, std::shared_ptr<std::string>>::value) {
+          if (v) AddString(*v);
+        } else if constexpr (
+            std::is_same<T, std::shared_ptr<const Tensor>>::value) {
+          if (v) AddTensor(*v);
+        } else if constexpr (std::is_arithmetic<T>::value) {
+          Add(v);
+        } else {
+          // vectors are stored inline
+          AddBytes(&v, sizeof(v));
+        }
+      },
+      value);
+}
+
+
+void Hasher::AddTensor(const Tensor& t) {
+  Add(static_cast<int>(t.dtype()));
+  Add(t.shape().size());
+  for (auto n : t.shape()) Add(n);
+
+  if (t.contiguous()) {
+    AddBytes(t.ptr(), t.bytes());
+  } else {
+    const auto c = t.Copy();
+    AddBytes(c->ptr(), c->bytes());
+  }
+}
+
+
+static bool EqualTensor(const Tensor& a, const Tensor& b) {
+  if (&a == &b) return true;
+  if (a.dtype() != b.dtype() || a.shape() != b.shape()) return false;
+
+  const auto ca = a.contiguous()? nullptr: a.Copy();
+  const auto cb = b.contiguous()? nullptr: b.Copy();
+  const auto& ta = ca? *ca: a;
+  const auto& tb = cb? *cb: b;
+  return std::memcmp(ta.ptr(), tb.ptr(), ta.bytes()) == 0;
+}
+
+// Compares values in the same way as Hasher::AddValue() hashes them.
+static bool EqualValue(const SharedAny& a, const SharedAny& b) {
+  if (a.index() != b.index()) return false;
+  return std::visit(
+      [&b](auto& va) {
+        using T = std::decay_t<decltype(va)>;
+        const auto& vb = std::get<T>(b);
+        if constexpr (std::is_same<T, std::shared_ptr<std::string>>::value) {
+          if (!va || !vb) return !va && !vb;
+          return *va == *vb;
+        } else if constexpr (
+            std::is_same<T, std::shared_ptr<const Tensor>>::value) {
+          if (!va || !vb) return !va && !vb;
+          return EqualTensor(*va, *vb);
+        } else {
+          // bitwise, so equal keys always have equal hashes
+          return std::memcmp(&va, &vb, sizeof(va)) == 0;
+        }
+      },
+      a);
+}
+
+
+bool MemoCache::Key::operator==(const Key& other) const {
+  if (hash != other.hash || node != other.node) return false;
+  if (in.size() != other.in.size()) return false;
+  for (size_t i = 0; i < in.size(); ++i) {
+    if (!EqualValue(in[i], other.in[i])) return false;
+  }
+  return true;
+}
+
+
+MemoCache::Key MemoCache::MakeKey(
+    const iNode& node, std::span<const SharedAny> in) {
+  Key ret;
+  Hasher node_hasher(&ret.node);
+  node.Serialize(&node_hasher);
+
+  Hasher hasher;
+  hasher.AddString(ret.node);
+  hasher.Add(in.size());
+  for (const auto& v : in) hasher.AddValue(v);
+
+  ret.hash = hasher.value();
+  ret.in.assign(in.begin(), in.end());
+  return ret;
+}
+
+size_t MemoCache::EstimateSize(const SharedAny& v) {
+  size_t ret = sizeof(v);
+  if (std::holds_alternative<std::shared_ptr<std::string>>(v)) {
+    const auto& str = std::get<std::shared_ptr<std::string>>(v);
+    if (str) ret += str->capacity();
+  }
+  if (std::holds_alternative<std::shared_ptr<const Tensor>>(v)) {
+    const auto& t = std::get<std::shared_ptr<const Tensor>>(v);
+    if (t) ret += t->bytes();
+  }
+  return ret;
+}
+
+
+std::shared_ptr<const MemoCache::Outputs> MemoCache::Find(const Key& key) {
+  std::lock_guard<std::mutex> _(mtx_);
+
+  auto itr = items_.find(key);
+  if (itr == items_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, itr->second);
+
+  ++hits_;
+  saved_ += itr->second->cost;
+  return itr->second->out;
+}
+
+void MemoCache::Store(Key key, Outputs&& out, Clock::duration cost) {
+  // Inputs held by the key are also counted.
+  size_t bytes = sizeof(Entry) + key.node.size();
+  for (const auto& v : key.in) bytes += EstimateSize(v);
+  for (const auto& v : out) {
+    if (v) bytes += EstimateSize(*v);
+  }
+
+  std::lock_guard<std::mutex> _(mtx_);
+  if (bytes > budget_) return;
+
+  auto itr = items_.find(key);
+  if (itr != items_.end()) {
+    bytes_ -= itr->second->bytes;
+    lru_.erase(itr->second);
+    items_.erase(itr);
+  }
+
+  auto ptr = std::make_shared<const Outputs>(std::move(out));
+  lru_.push_front(Entry {key, std::move(ptr), bytes, cost});
+  items_[std::move(key)] = lru_.begin();
+  bytes_ += bytes;
+  Evict();
+}
+
+void MemoCache::Clear() {
+  std::lock_guard<std::mutex> _(mtx_);
+  lru_.clear();
+  items_.clear();
+  bytes_ = 0;
+}
+
+
+void MemoCache::budget(size_t n) {
+  std::lock_guard<std::mutex> _(mtx_);
+  budget_ = n;
+  Evict();
+}
+
+MemoCache::Stats MemoCache::stats() const {
+  std::lock_guard<std::mutex> _(mtx_);
+
+  Stats ret;
+  ret.hits      = hits_;
+  ret.misses    = misses_;
+  ret.evictions = evictions_;
+  ret.entries   = items_.size();
+  ret.bytes     = bytes_;
+  ret.budget    = budget_;
+  ret.saved     = saved_;
+  return ret;
+}
+
+
+void MemoCache::Evict() {
+  while (bytes_ > budget_) {
+    assert(!lru_.empty());
+
+    auto& e = lru_.back();
+    bytes_ -= e.bytes;
+    items_.erase(e.key);
+    lru_.pop_back();
+    ++evictions_;
+  }
+}
+
+}  // namespace mnian::core
@@ -0,0 +1,223 @@
+// No copyright
+//
+// This file declares a cache of lambda outputs keyed by node and its inputs,
+// so an execution with the same inputs as before can be skipped.
+#pragma once
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "mncore/conv.h"
+#include "mncore/node.h"
+#include "mncore/serialize.h"
+#include "mncore/task.h"
+#include "mncore/tensor.h"
+
+
+namespace mnian::core {
+
+// Hasher is a serializer which computes FNV-1a hash of the serialized data
+// instead of writing it. The data is also appended to `record` if it's not
+// null.
+class Hasher final : public iSerializer {
+ public:
+  static constexpr uint64_t kBasis = 14695981039346656037u;
+  static constexpr uint64_t kPrime = 1099511628211u;
+
+
+  explicit Hasher(std::string* record = nullptr) : record_(record) {
+  }
+
+  Hasher(const Hasher&) = delete;
+  Hasher(Hasher&&) = delete;
+
+  Hasher& operator=(const Hasher&) = delete;
+  Hasher& operator=(Hasher&&) = delete;
+
+
+  void SerializeMap(size_t n) override {
+    Add('m');
+    Add(n);
+  }
+  void SerializeArray(size_t n) override {
+    Add('a');
+    Add(n);
+  }
+  void SerializeKey(const std::string& key) override {
+    Add('k');
+    AddString(key);
+  }
+  void SerializeValue(const Any& value) override;
+
+
+  // Hashes the content of value, not an address of the shared object.
+  void AddValue(const SharedAny& value);
+  void AddTensor(const Tensor& t);
+
+  void AddString(std::string_view str) {
+    Add(str.size());
+    AddBytes(str.data(), str.size());
+  }
+
+  template <typename T>
+  void Add(T v) {
+    static_assert(std::is_arithmetic<T>::value);
+    AddBytes(&v, sizeof(v));
+  }
+
+  void AddBytes(const void* ptr, size_t n) {
+    auto p = static_cast<const uint8_t*>(ptr);
+    for (size_t i = 0; i < n; ++i) {
+      hash_ = (hash_ ^ p[i]) * kPrime;
+    }
+    if (record_) record_->append(static_cast<const char*>(ptr), n);
+  }
+
+
+  uint64_t value() const {
+    return hash_;
+  }
+
+ private:
+  uint64_t hash_ = kBasis;
+
+  std::string* record_;
+};
+
+
+// MemoCache holds outputs of node executions within a memory budget, and
+// evicts the least recently used ones when the budget is exceeded. This is
+// thread-safe.
+//
+// Entries are looked up by a hash, but a hit also compares the node and input
+// values held by the key, so a collision of hashes is just a miss.
+class MemoCache final {
+ public:
+  using Clock   = std::chrono::steady_clock;
+  using Outputs = std::vector<iLambda::Value>;
+
+  static constexpr size_t kDefaultBudget = size_t{256} * 1024 * 1024;
+
+
+  struct Key final {
+   public:
+    // Compares the contents of values, not addresses of shared objects.
+    bool operator==(const Key& other) const;
+
+    uint64_t hash = 0;
+
+    // the serialized node type and parameters
+    std::string node;
+
+    std::vector<SharedAny> in;
+  };
+  struct KeyHash final {
+   public:
+    size_t operator()(const Key& key) const {
+      return static_cast<size_t>(key.hash);
+    }
+  };
+
+
+  struct Stats final {
+   public:
+    double hitRatio() const {
+      const auto total = hits + misses;
+      return total? static_cast<double>(hits)/static_cast<double>(total): 0.;
+    }
+
+
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+
+    uint64_t entries = 0;
+    uint64_t bytes   = 0;
+    uint64_t budget  = 0;
+
+    // a sum of execution time of entries served by hits
+    Clock::duration saved = Clock::duration::zero();
+  };
+
+
+  // Makes a key from the node type, its parameters, and the input values. The
+  // key shares the values, so they are alive as long as the entry is.
+  static Key MakeKey(const iNode& node, std::span<const SharedAny> in);
+
+  // Returns an approximate number of bytes that the value holds.
+  static size_t EstimateSize(const SharedAny& v);
+
+
+  explicit MemoCache(size_t budget = kDefaultBudget) : budget_(budget) {
+  }
+
+  MemoCache(const MemoCache&) = delete;
+  MemoCache(MemoCache&&) = delete;
+
+  MemoCache& operator=(const MemoCache&) = delete;
+  MemoCache& operator=(MemoCache&&) = delete;
+
+
+  // Returns outputs stored with the key or nullptr, and the entry becomes the
+  // most recently used one.
+  std::shared_ptr<const Outputs> Find(const Key& key);
+
+  // Stores outputs that took the duration to compute. Outputs larger than the
+  // budget are not stored.
+  void Store(Key key, Outputs&& out, Clock::duration cost);
+
+  void Clear();
+
+
+  void budget(size_t n);
+  size_t budget() const {
+    std::lock_guard<std::mutex> _(mtx_);
+    return budget_;
+  }
+
+  Stats stats() const;
+
+ private:
+  struct Entry final {
+   public:
+    Key key;
+
+    std::shared_ptr<const Outputs> out;
+
+    size_t bytes;
+
+    Clock::duration cost;
+  };
+
+
+  // The lock must be held.
+  void Evict();
+
+
+  mutable std::mutex mtx_;
+
+  size_t budget_;
+  size_t bytes_ = 0;
+
+  // the front is the most recently used
+  std::list<Entry> lru_;
+
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> items_;
+
+  uint64_t hits_      = 0;
+  uint64_t misses_    = 0;
+  uint64_t evictions_ = 0;
+
+  Clock::duration saved_ = Clock::duration::zero();
+};
+
+}  // namespace mnian::core
@@ -0,0 +1,48 @@
+// No copyright
+#include "mncore/metrics.h"
+
+
+namespace mnian::core {
+
+double TaskMetrics::Sample::IdleRatio(const Sample& prev, const Sample& next) {
+  if (next.time_ns <= prev.time_ns || !next.workers) return 0;
+
+  const auto total = (next.time_ns - prev.time_ns)*next.workers;
+  const auto idle  = next.parked_ns - prev.parked_ns;
+  return static_cast<double>(idle) / static_cast<double>(total);
+}
+
+void TaskMetrics::Sample::Serialize(iSerializer* serial) const {
+  iSerializer::ArrayGuard latency(serial, latency_us.size());
+  for (auto v : latency_us) latency.Add(static_cast<int64_t>(v));
+
+  iSerializer::ArrayGuard exec(serial, exec_us.size());
+  for (auto v : exec_us) exec.Add(static_cast<int64_t>(v));
+
+  iSerializer::MapGuard root(serial);
+  root.Add("time_ns",    static_cast<int64_t>(time_ns));
+  root.Add("depth",      static_cast<int64_t>(depth));
+  root.Add("attached",   static_cast<int64_t>(attached));
+  root.Add("workers",    static_cast<int64_t>(workers));
+  root.Add("pushed",     static_cast<int64_t>(pushed));
+  root.Add("executed",   static_cast<int64_t>(executed));
+  root.Add("steals",     static_cast<int64_t>(steals));
+  root.Add("parks",      static_cast<int64_t>(parks));
+  root.Add("parked_ns",  static_cast<int64_t>(parked_ns));
+  root.Add("exec_ns",    static_cast<int64_t>(exec_ns));
+  root.Add("latency_us", &latency);
+  root.Add("exec_us",    &exec);
+}
+
+void TaskMetrics::Fill(Sample* s) const {
+  s->pushed     = pushed_.load(std::memory_order_relaxed);
+  s->executed   = executed_.load(std::memory_order_relaxed);
+  s->steals     = steals_.load(std::memory_order_relaxed);
+  s->parks      = parks_.load(std::memory_order_relaxed);
+  s->parked_ns  = parked_ns_.load(std::memory_order_relaxed);
+  s->exec_ns    = exec_ns_.load(std::memory_order_relaxed);
+  s->latency_us = latency_us_.sample();
+  s->exec_us    = exec_us_.sample();
+}
+
+}  // namespace mnian::core
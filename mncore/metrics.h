@@ -0,0 +1,137 @@
+// No copyright
+//
+// This file declares lock-free counters of the task system, which can be
+// sampled at any time from any thread.
+#pragma once
+
+#include <array>
+#include <atomic>  // NOLINT(build/c++11)
+#include <bit>
+#include <cstdint>
+
+#include "mncore/serialize.h"
+
+
+namespace mnian::core {
+
+// Histogram counts values in buckets of powers of 2. The bucket i holds values
+// in [2^(i-1), 2^i), and the bucket 0 holds zeros.
+class Histogram final {
+ public:
+  static constexpr size_t kBuckets = 32;
+
+  using Sample = std::array<uint64_t, kBuckets>;
+
+
+  static size_t Bucket(uint64_t v) {
+    const auto i = static_cast<size_t>(std::bit_width(v));
+    return i < kBuckets? i: kBuckets-1;
+  }
+
+
+  Histogram() = default;
+
+  Histogram(const Histogram&) = delete;
+  Histogram(Histogram&&) = delete;
+
+  Histogram& operator=(const Histogram&) = delete;
+  Histogram& operator=(Histogram&&) = delete;
+
+
+  void Add(uint64_t v) {
+    buckets_[Bucket(v)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Sample sample() const {
+    Sample ret;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      ret[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_ = {};
+};
+
+
+// TaskMetrics is a set of counters updated by TaskQueue. All counters are
+// cumulative, so consumers take differences of two samples to get rates.
+class TaskMetrics final {
+ public:
+  struct Sample final : public iSerializable {
+   public:
+    // Returns a ratio of time that workers spent parking between the samples.
+    static double IdleRatio(const Sample& prev, const Sample& next);
+
+
+    void Serialize(iSerializer* serial) const override;
+
+
+    // steady clock when sampled
+    uint64_t time_ns = 0;
+
+    // a number of ready tasks, and tasks attached but not executed yet
+    uint64_t depth    = 0;
+    uint64_t attached = 0;
+
+    uint64_t workers = 0;
+
+    uint64_t pushed   = 0;
+    uint64_t executed = 0;
+    uint64_t steals   = 0;
+    uint64_t parks    = 0;
+
+    uint64_t parked_ns = 0;
+    uint64_t exec_ns   = 0;
+
+    // from getting ready to start of execution, in microseconds
+    Histogram::Sample latency_us = {};
+
+    // in microseconds
+    Histogram::Sample exec_us = {};
+  };
+
+
+  TaskMetrics() = default;
+
+  TaskMetrics(const TaskMetrics&) = delete;
+  TaskMetrics(TaskMetrics&&) = delete;
+
+  TaskMetrics& operator=(const TaskMetrics&) = delete;
+  TaskMetrics& operator=(TaskMetrics&&) = delete;
+
+
+  void Push(uint64_t n = 1) {
+    pushed_.fetch_add(n, std::memory_order_relaxed);
+  }
+  void Exec(uint64_t latency_ns, uint64_t exec_ns) {
+    executed_.fetch_add(1, std::memory_order_relaxed);
+    exec_ns_.fetch_add(exec_ns, std::memory_order_relaxed);
+    latency_us_.Add(latency_ns/1000);
+    exec_us_.Add(exec_ns/1000);
+  }
+  void Steal() {
+    steals_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void Park(uint64_t ns) {
+    parks_.fetch_add(1, std::memory_order_relaxed);
+    parked_ns_.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  // Fills counters of the sample, except ones held by the queue.
+  void Fill(Sample* s) const;
+
+ private:
+  std::atomic<uint64_t> pushed_    = 0;
+  std::atomic<uint64_t> executed_  = 0;
+  std::atomic<uint64_t> steals_    = 0;
+  std::atomic<uint64_t> parks_     = 0;
+  std::atomic<uint64_t> parked_ns_ = 0;
+  std::atomic<uint64_t> exec_ns_   = 0;
+
+  Histogram latency_us_;
+  Histogram exec_us_;
+};
+
+}  // namespace mnian::core
@@ -26,6 +26,22 @@ iNode* iNode::DeserializeRef(iDeserializer* des) {
 }
 
 
+iNode::ProcessRef iNode::EnqueueProgressive() {
+  auto ret  = EnqueueLambda(kPreview);
+  auto full = EnqueueLambda(kFull);
+
+  ret.lambda()->priority(iTask::kInteractive);
+  full.lambda()->priority(iTask::kBackground);
+
+  // The full one always finishes after the preview, so its result is never
+  // overwritten by the preview.
+  ret.lambda()->AddChild(full.lambda());
+
+  ret.Refine(std::move(full));
+  return ret;
+}
+
+
 std::unordered_map<const iNode::Socket*, size_t>
 iNode::CreateSocketIndexMap() const {
   std::unordered_map<const iNode::Socket*, size_t> ret;
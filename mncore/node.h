@@ -16,6 +16,7 @@
 
 #include "mncore/action.h"
 #include "mncore/conv.h"
+#include "mncore/pool.h"
 #include "mncore/serialize.h"
 #include "mncore/store.h"
 #include "mncore/task.h"
@@ -78,6 +79,14 @@ class iNode : public iActionable, public iPolymorphicSerializable {
   using Store = ObjectStore<iNode>;
   using Tag   = Store::Tag;
 
+  // A level of detail that a lambda should produce. Nodes may produce a cheap
+  // approximation for kPreview, such as a result in low resolution, or just
+  // ignore it.
+  enum Quality {
+    kPreview,
+    kFull,
+  };
+
   class Socket;
   class Process;
   class ProcessRef;
@@ -109,7 +118,16 @@ class iNode : public iActionable, public iPolymorphicSerializable {
 
   virtual std::unique_ptr<iNode> Clone() = 0;
 
-  virtual ProcessRef EnqueueLambda() = 0;
+  // Creates a lambda that is attached to a queue but not triggered yet. Since
+  // this is called frequently, the lambda and Process should be allocated by
+  // MakePooled(). The lambda should set kAborted to the Process in DoCancel(),
+  // which is called when it's aborted before starting.
+  virtual ProcessRef EnqueueLambda(Quality quality) = 0;
+
+  // Creates a preview lambda and a full quality one which starts after the
+  // preview, and refines the result in background. Both are in the returned
+  // ProcessRef.
+  ProcessRef EnqueueProgressive();
 
 
   std::unordered_map<const Socket*, size_t> CreateSocketIndexMap() const;
@@ -126,7 +144,7 @@ class iNode : public iActionable, public iPolymorphicSerializable {
     return input_.size();
   }
   size_t outputCount() const {
-    return input_.size();
+    return output_.size();
   }
 
   const Socket& input(size_t i) const {
@@ -211,6 +229,18 @@ class iNode::Socket final {
     if (std::holds_alternative<std::shared_ptr<std::string>>(v)) {
       return kString;
     }
+    if (std::holds_alternative<std::shared_ptr<const Tensor>>(v)) {
+      return kTensor;
+    }
+    if (std::holds_alternative<Vec2>(v)) {
+      return kVec2;
+    }
+    if (std::holds_alternative<Vec3>(v)) {
+      return kVec3;
+    }
+    if (std::holds_alternative<Vec4>(v)) {
+      return kVec4;
+    }
     assert(false);
     return kInteger;
   }
@@ -231,6 +261,31 @@ class iNode::Socket final {
   Socket& operator=(Socket&&) = delete;
 
 
+  // Restores a value converted by FromSharedAny() and ToSharedAny(), whose
+  // type might be lost. Returns the default if it's broken.
+  SharedAny Restore(SharedAny&& v) const {
+    switch (type_) {
+    case kVec2:
+      return RestoreVec<2>(std::move(v));
+    case kVec3:
+      return RestoreVec<3>(std::move(v));
+    case kVec4:
+      return RestoreVec<4>(std::move(v));
+    case kTensor:
+      break;
+    default:
+      return std::move(v);
+    }
+
+    if (std::holds_alternative<std::shared_ptr<std::string>>(v)) {
+      const auto& str = std::get<std::shared_ptr<std::string>>(v);
+      if (auto t = Tensor::Decode(*str)) return t;
+    }
+    return std::holds_alternative<std::shared_ptr<const Tensor>>(v)?
+        std::move(v): def_;
+  }
+
+
   size_t index() const {
     return index_;
   }
@@ -245,6 +300,16 @@ class iNode::Socket final {
   }
 
  private:
+  template <int M>
+  SharedAny RestoreVec(SharedAny&& v) const {
+    if (std::holds_alternative<std::shared_ptr<std::string>>(v)) {
+      const auto& str = std::get<std::shared_ptr<std::string>>(v);
+      if (auto ret = ParseVec<M>(*str)) return *ret;
+    }
+    return std::holds_alternative<Vec<M>>(v)? std::move(v): def_;
+  }
+
+
   size_t index_;
 
   Type      type_;
@@ -332,15 +397,28 @@ class iNode::ProcessRef final {
   ProcessRef& operator=(ProcessRef&&) = default;
 
 
+  // Also cancels the lambda, so it and all of its descendants not started
+  // yet are skipped. The refinement is also aborted.
   void RequestAbort() {
     proc_->RequestAbort();
+    lambda_->Cancel();
+    if (next_) next_->RequestAbort();
+  }
+
+  // Appends a process which refines the result of this later.
+  void Refine(ProcessRef&& next) {
+    assert(!next.empty());
+    if (next_) {
+      next_->Refine(std::move(next));
+    } else {
+      next_ = std::make_unique<ProcessRef>(std::move(next));
+    }
   }
 
 
+  // Returns true while this or the refinement is running.
   bool busy() const {
-    return proc_ &&
-        state() != Process::kFinished &&
-        state() != Process::kAborted;
+    return proc_ && (busyThis() || (next_ && next_->busy()));
   }
   bool empty() const {
     return !proc_;
@@ -349,21 +427,37 @@ class iNode::ProcessRef final {
   const std::shared_ptr<iLambda>& lambda() const {
     return lambda_;
   }
+  const ProcessRef* refinement() const {
+    return next_.get();
+  }
 
+  // The following getters refer the first process which is not done yet,
+  // or the last one.
   Process::State state() const {
-    return proc_->state();
+    return current().proc_->state();
   }
   double progress() const {
-    return proc_->progress();
+    return current().proc_->progress();
   }
   std::string msg() const {
-    return proc_->msg();
+    return current().proc_->msg();
   }
 
  private:
+  bool busyThis() const {
+    const auto st = proc_->state();
+    return st != Process::kFinished && st != Process::kAborted;
+  }
+  const ProcessRef& current() const {
+    return next_ && !busyThis()? next_->current(): *this;
+  }
+
+
   std::shared_ptr<iLambda> lambda_;
 
   std::shared_ptr<Process> proc_;
+
+  std::unique_ptr<ProcessRef> next_;
 };
 
 }  // namespace mnian::core
@@ -0,0 +1,293 @@
+// No copyright
+//
+// This file declares helpers to split a work of node into tasks executed in
+// parallel.
+#pragma once
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mncore/node.h"
+#include "mncore/pool.h"
+#include "mncore/task.h"
+
+
+namespace mnian::core {
+
+struct ParallelOptions final {
+ public:
+  // A process which receives progress, and whose abort request skips the rest
+  // of works.
+  std::shared_ptr<iNode::Process> proc;
+
+  std::shared_ptr<CancelToken> token;
+
+  iTask::Priority priority = iTask::kNormal;
+};
+
+
+// A state shared by all tasks of a parallel execution.
+template <typename Leaf>
+class ParallelState final {
+ public:
+  ParallelState() = delete;
+  ParallelState(TaskQueue*             q,
+                size_t                 begin,
+                size_t                 end,
+                size_t                 grain,
+                Leaf                   leaf,
+                const ParallelOptions& opts,
+                std::shared_ptr<iTask> join) :
+      q_(q), begin_(begin), total_(end-begin), grain_(grain),
+      leaf_(std::move(leaf)), opts_(opts), join_(std::move(join)) {
+    assert(q_);
+    assert(grain_);
+    assert(join_);
+  }
+
+  ParallelState(const ParallelState&) = delete;
+  ParallelState(ParallelState&&) = delete;
+
+  ParallelState& operator=(const ParallelState&) = delete;
+  ParallelState& operator=(ParallelState&&) = delete;
+
+
+  // Attaches the task as a parent of the join task, and triggers it.
+  void Spawn(const std::shared_ptr<iTask>& task) {
+    task->priority(opts_.priority);
+    if (opts_.token) task->token(opts_.token);
+    task->AddChild(join_);
+
+    q_->Attach(task);
+    task->Trigger();
+  }
+
+  void Exec(size_t begin, size_t end) {
+    leaf_(begin, end);
+
+    const auto done = done_ += end-begin;
+    if (opts_.proc) {
+      opts_.proc->progress(
+          static_cast<double>(done) / static_cast<double>(total_));
+    }
+  }
+
+
+  bool aborted() const {
+    return
+        (opts_.token && opts_.token->cancelled()) ||
+        (opts_.proc  && opts_.proc->abort());
+  }
+
+  size_t begin() const {
+    return begin_;
+  }
+  size_t grain() const {
+    return grain_;
+  }
+
+ private:
+  TaskQueue* q_;
+
+  size_t begin_;
+  size_t total_;
+  size_t grain_;
+
+  Leaf leaf_;
+
+  ParallelOptions opts_;
+
+  std::shared_ptr<iTask> join_;
+
+  std::atomic<size_t> done_ = 0;
+};
+
+// A task executing a range, which forks the right half into new task
+// recursively until the range fits to the grain, so idle workers can steal
+// larger ranges.
+template <typename Leaf>
+class ParallelTask final : public iTask {
+ public:
+  using State = ParallelState<Leaf>;
+
+
+  ParallelTask() = delete;
+  ParallelTask(const std::shared_ptr<State>& st, size_t begin, size_t end) :
+      st_(st), begin_(begin), end_(end) {
+    assert(begin_ < end_);
+  }
+
+  ParallelTask(const ParallelTask&) = delete;
+  ParallelTask(ParallelTask&&) = delete;
+
+  ParallelTask& operator=(const ParallelTask&) = delete;
+  ParallelTask& operator=(ParallelTask&&) = delete;
+
+ protected:
+  void DoExec() override {
+    const auto grain = st_->grain();
+
+    auto end = end_;
+    while (!st_->aborted() && end-begin_ > grain) {
+      // Splits on a boundary of grain, so every leaf is aligned to the grain.
+      const auto n   = (end-begin_+grain-1)/grain;
+      const auto mid = begin_ + n/2*grain;
+      st_->Spawn(MakePooled<ParallelTask>(st_, mid, end));
+      end = mid;
+    }
+
+    // Cancelling this makes the join task cancelled too.
+    if (st_->aborted()) {
+      Cancel();
+      return;
+    }
+    st_->Exec(begin_, end);
+  }
+
+ private:
+  std::shared_ptr<State> st_;
+
+  size_t begin_;
+  size_t end_;
+};
+
+
+// Starts a parallel execution of the leaf, and the join task becomes ready
+// when all leaves are done.
+template <typename Leaf>
+void StartParallel(TaskQueue*                    q,
+                   size_t                        begin,
+                   size_t                        end,
+                   size_t                        grain,
+                   Leaf&&                        leaf,
+                   const ParallelOptions&        opts,
+                   const std::shared_ptr<iTask>& join) {
+  assert(begin <= end);
+
+  join->priority(opts.priority);
+  q->Attach(join);
+
+  if (begin < end) {
+    using L = std::decay_t<Leaf>;
+
+    auto st = MakePooled<ParallelState<L>>(
+        q, begin, end, grain, std::forward<Leaf>(leaf), opts, join);
+    st->Spawn(MakePooled<ParallelTask<L>>(st, begin, end));
+  }
+  join->Trigger();
+}
+
+
+// Executes fn(begin, end) for each chunk of the range on the queue in
+// parallel, whose size is up to the grain. The returned task is done when all
+// chunks are done, and is cancelled when the execution is aborted. Callers can
+// wait for it without blocking, by AddChild() or iCoLambda::Await().
+template <typename F>
+std::shared_ptr<iTask> ParallelFor(TaskQueue*             q,
+                                   size_t                 begin,
+                                   size_t                 end,
+                                   size_t                 grain,
+                                   F&&                    fn,
+                                   const ParallelOptions& opts = {}) {
+  auto join = MakePooled<Task>([]() { });
+  StartParallel(q, begin, end, grain, std::forward<F>(fn), opts, join);
+  return join;
+}
+
+
+// A task which holds a result of ParallelReduce().
+template <typename T>
+class ParallelResult : public iTask {
+ public:
+  ParallelResult() = default;
+
+  ParallelResult(const ParallelResult&) = delete;
+  ParallelResult(ParallelResult&&) = delete;
+
+  ParallelResult& operator=(const ParallelResult&) = delete;
+  ParallelResult& operator=(ParallelResult&&) = delete;
+
+
+  // The result is available after the task is done.
+  const T& result() const {
+    assert(state() == kDone);
+    return result_;
+  }
+
+ protected:
+  T result_;
+};
+
+template <typename T, typename Reduce>
+class ParallelReduceTask final : public ParallelResult<T> {
+ public:
+  ParallelReduceTask() = delete;
+  ParallelReduceTask(size_t n, T&& init, Reduce&& reduce) :
+      partials_(n), reduce_(std::move(reduce)) {
+    this->result_ = std::move(init);
+  }
+
+  ParallelReduceTask(const ParallelReduceTask&) = delete;
+  ParallelReduceTask(ParallelReduceTask&&) = delete;
+
+  ParallelReduceTask& operator=(const ParallelReduceTask&) = delete;
+  ParallelReduceTask& operator=(ParallelReduceTask&&) = delete;
+
+
+  // Each leaf stores its result to its own slot, so no lock is needed.
+  std::optional<T>& partial(size_t i) {
+    return partials_[i];
+  }
+
+ protected:
+  void DoExec() override {
+    // Partials are reduced in order of the range, so the result is
+    // deterministic even if the reduction is not commutative.
+    for (auto& p : partials_) {
+      if (p) this->result_ = reduce_(std::move(this->result_), std::move(*p));
+    }
+    partials_.clear();
+  }
+
+ private:
+  std::vector<std::optional<T>, PoolAllocator<std::optional<T>>> partials_;
+
+  Reduce reduce_;
+};
+
+// Executes map(begin, end) for each chunk of the range in parallel like
+// ParallelFor(), and reduces their results with reduce(T, T) from init. The
+// reduction must be associative.
+template <typename T, typename Map, typename Reduce>
+std::shared_ptr<ParallelResult<T>> ParallelReduce(
+    TaskQueue*             q,
+    size_t                 begin,
+    size_t                 end,
+    size_t                 grain,
+    T                      init,
+    Map&&                  map,
+    Reduce&&               reduce,
+    const ParallelOptions& opts = {}) {
+  assert(grain);
+
+  using R = std::decay_t<Reduce>;
+
+  const auto n = (end-begin+grain-1)/grain;
+  auto join = MakePooled<ParallelReduceTask<T, R>>(
+      n, std::move(init), R(std::forward<Reduce>(reduce)));
+
+  // The state holds the join task until all leaves are done.
+  auto leaf = [j = join.get(), begin, grain, map = std::forward<Map>(map)](
+      size_t b, size_t e) mutable {
+    j->partial((b-begin)/grain) = map(b, e);
+  };
+  StartParallel(q, begin, end, grain, std::move(leaf), opts, join);
+  return join;
+}
+
+}  // namespace mnian::core
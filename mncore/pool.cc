@@ -0,0 +1,273 @@
+// No copyright
+#include "mncore/pool.h"
+
+#include <array>
+#include <atomic>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <mutex>  // NOLINT(build/c++11)
+#include <new>
+#include <vector>
+
+
+namespace mnian::core {
+
+static constexpr size_t kSlabSize = 64*1024;
+
+// A thread cache keeps at most this number of free blocks for each class, and
+// moves the half to the global one when exceeded.
+static constexpr size_t kCacheMax = 256;
+
+static constexpr std::array<size_t, 12> kClassSizes = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+};
+static_assert(kClassSizes.back() == Pool::kMaxSize);
+
+
+static size_t GetClass(size_t n) {
+  assert(n <= Pool::kMaxSize);
+
+  size_t i = 0;
+  while (kClassSizes[i] < n) ++i;
+  return i;
+}
+
+
+namespace {
+
+struct Block final {
+ public:
+  Block* next;
+};
+
+struct FreeList final {
+ public:
+  void Push(Block* b) {
+    b->next = head;
+    head    = b;
+    ++count;
+  }
+  Block* Pop() {
+    auto ret = head;
+    if (ret) {
+      head = ret->next;
+      --count;
+    }
+    return ret;
+  }
+
+  Block* head  = nullptr;
+  size_t count = 0;
+};
+
+
+struct Arena final {
+ public:
+  std::mutex mtx;
+
+  std::array<FreeList, kClassSizes.size()> lists;
+};
+
+thread_local size_t arena_ = 0;
+
+
+// Counts objects allocated and released by a thread. Each counter is written
+// only by the thread, so the increment needs no read-modify-write.
+struct Counters final {
+ public:
+  static void Increment(std::atomic<uint64_t>& c) {
+    c.store(c.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> hits      = 0;
+  std::atomic<uint64_t> fallbacks = 0;
+  std::atomic<uint64_t> frees     = 0;
+};
+
+struct Cache;
+
+
+// The global pool is never deleted because pooled objects might be released
+// after static destructors.
+struct Global final {
+ public:
+  static Global& instance() {
+    static auto ret = new Global;
+    return *ret;
+  }
+
+  void Refill(FreeList* list, size_t c) {
+    const auto size = kClassSizes[c];
+    {
+      auto& a = arenas[arena_];
+
+      std::lock_guard<std::mutex> _(a.mtx);
+      for (size_t i = 0; i < kCacheMax/2; ++i) {
+        auto b = a.lists[c].Pop();
+        if (!b) break;
+        list->Push(b);
+      }
+    }
+    if (list->head) return;
+
+    // The slab is first touched by the current thread, so OS places it on the
+    // thread's NUMA node.
+    auto slab = static_cast<uint8_t*>(::operator new(kSlabSize));
+    chunk_allocs.fetch_add(1, std::memory_order_relaxed);
+    chunk_bytes.fetch_add(kSlabSize, std::memory_order_relaxed);
+
+    for (size_t i = 0; i+size <= kSlabSize; i += size) {
+      list->Push(new (slab+i) Block);
+    }
+  }
+  void Return(FreeList* list, size_t n, size_t c) {
+    auto& a = arenas[arena_];
+
+    std::lock_guard<std::mutex> _(a.mtx);
+    for (size_t i = 0; i < n; ++i) {
+      auto b = list->Pop();
+      if (!b) break;
+      a.lists[c].Push(b);
+    }
+  }
+
+  std::array<Arena, Pool::kMaxArenas> arenas;
+
+  std::atomic<size_t> chunk_allocs = 0;
+  std::atomic<size_t> chunk_bytes  = 0;
+
+  // Counters of alive threads are summed up by Pool::stats(), and ones of
+  // dead threads are accumulated here.
+  std::mutex          caches_mtx;
+  std::vector<Cache*> caches;
+
+  std::atomic<uint64_t> hits      = 0;
+  std::atomic<uint64_t> fallbacks = 0;
+  std::atomic<uint64_t> frees     = 0;
+};
+
+
+struct Cache final {
+ public:
+  Cache();
+  ~Cache();
+
+  std::array<FreeList, kClassSizes.size()> lists;
+
+  Counters counters;
+};
+
+thread_local Cache cache_;
+thread_local bool  cache_dead_ = false;
+
+Cache::Cache() {
+  auto& g = Global::instance();
+
+  std::lock_guard<std::mutex> _(g.caches_mtx);
+  g.caches.push_back(this);
+}
+Cache::~Cache() {
+  auto& g = Global::instance();
+  for (size_t c = 0; c < lists.size(); ++c) {
+    g.Return(&lists[c], lists[c].count, c);
+  }
+  {
+    std::lock_guard<std::mutex> _(g.caches_mtx);
+    std::erase(g.caches, this);
+    g.hits      += counters.hits;
+    g.fallbacks += counters.fallbacks;
+    g.frees     += counters.frees;
+  }
+  cache_dead_ = true;
+}
+
+}  // namespace
+
+
+void* Pool::Allocate(size_t n) {
+  auto& g = Global::instance();
+  if (n > kMaxSize) {
+    if (cache_dead_) {
+      ++g.fallbacks;
+    } else {
+      Counters::Increment(cache_.counters.fallbacks);
+    }
+    g.chunk_allocs.fetch_add(1, std::memory_order_relaxed);
+    g.chunk_bytes.fetch_add(n, std::memory_order_relaxed);
+    return ::operator new(n);
+  }
+
+  const auto c = GetClass(n);
+  if (cache_dead_) {
+    // The thread is exiting, so a temporary cache is used.
+    ++g.hits;
+
+    FreeList list;
+    g.Refill(&list, c);
+
+    auto ret = list.Pop();
+    g.Return(&list, list.count, c);
+    return ret;
+  }
+  Counters::Increment(cache_.counters.hits);
+
+  auto& list = cache_.lists[c];
+  if (!list.head) g.Refill(&list, c);
+  return list.Pop();
+}
+
+void Pool::Deallocate(void* ptr, size_t n) {
+  if (!ptr) return;
+
+  auto& g = Global::instance();
+  if (cache_dead_) {
+    ++g.frees;
+  } else {
+    Counters::Increment(cache_.counters.frees);
+  }
+
+  if (n > kMaxSize) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  const auto c = GetClass(n);
+  if (cache_dead_) {
+    FreeList list;
+    list.Push(new (ptr) Block);
+    g.Return(&list, 1, c);
+    return;
+  }
+
+  auto& list = cache_.lists[c];
+  list.Push(new (ptr) Block);
+  if (list.count > kCacheMax) g.Return(&list, kCacheMax/2, c);
+}
+
+void Pool::arena(size_t index) {
+  arena_ = index%kMaxArenas;
+}
+size_t Pool::arena() {
+  return arena_;
+}
+
+Pool::Stats Pool::stats() {
+  auto& g = Global::instance();
+
+  Stats ret {
+    .chunk_allocs = g.chunk_allocs.load(std::memory_order_relaxed),
+    .chunk_bytes  = g.chunk_bytes.load(std::memory_order_relaxed),
+  };
+
+  std::lock_guard<std::mutex> _(g.caches_mtx);
+  ret.hits      = g.hits;
+  ret.fallbacks = g.fallbacks;
+  ret.frees     = g.frees;
+  for (auto c : g.caches) {
+    ret.hits      += c->counters.hits.load(std::memory_order_relaxed);
+    ret.fallbacks += c->counters.fallbacks.load(std::memory_order_relaxed);
+    ret.frees     += c->counters.frees.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+}  // namespace mnian::core
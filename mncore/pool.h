@@ -0,0 +1,107 @@
+// No copyright
+//
+// This file declares a thread-aware pool allocator for small objects which are
+// created and destroyed frequently, such as tasks.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+
+namespace mnian::core {
+
+// Pool allocates memory blocks from free lists of fixed size classes. Each
+// thread has its own cache of free lists, so no lock is needed in most cases,
+// and blocks freed by a thread are reused by the thread. Requests larger than
+// kMaxSize fall back to the heap.
+//
+// Blocks overflowing from thread caches are shared through an arena selected
+// by each thread. Threads on the same NUMA node should select the same arena,
+// so blocks are never passed to other nodes.
+class Pool final {
+ public:
+  static constexpr size_t kAlign     = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+  static constexpr size_t kMaxSize   = 1024;
+  static constexpr size_t kMaxArenas = 8;
+
+  struct Stats {
+   public:
+    // numbers of objects allocated by Allocate(), served from free lists or
+    // from the heap because they are too large for the pool
+    uint64_t hits      = 0;
+    uint64_t fallbacks = 0;
+
+    // a number of objects released by Deallocate()
+    uint64_t frees = 0;
+
+    // a number of memory chunks allocated from the heap, which are slabs or
+    // blocks too large for the pool
+    size_t chunk_allocs = 0;
+
+    size_t chunk_bytes = 0;
+  };
+
+
+  Pool() = delete;
+
+
+  static void* Allocate(size_t n);
+  static void Deallocate(void* ptr, size_t n);
+
+  // Selects an arena used by the current thread. The index is wrapped around
+  // kMaxArenas.
+  static void arena(size_t index);
+  static size_t arena();
+
+  static Stats stats();
+};
+
+
+// An allocator compatible with STL containers and std::allocate_shared().
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) {  // NOLINT(runtime/explicit)
+  }
+
+
+  T* allocate(size_t n) {
+    if constexpr (alignof(T) > Pool::kAlign) {
+      return std::allocator<T>().allocate(n);
+    } else {
+      return static_cast<T*>(Pool::Allocate(n*sizeof(T)));
+    }
+  }
+  void deallocate(T* ptr, size_t n) {
+    if constexpr (alignof(T) > Pool::kAlign) {
+      std::allocator<T>().deallocate(ptr, n);
+    } else {
+      Pool::Deallocate(ptr, n*sizeof(T));
+    }
+  }
+
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>&) const {
+    return true;
+  }
+};
+
+
+// Creates an object whose control block and itself are allocated from Pool.
+template <typename T, typename... Args>
+std::shared_ptr<T> MakePooled(Args&&... args) {
+  return std::allocate_shared<T>(
+      PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+}  // namespace mnian::core
@@ -60,4 +60,26 @@ std::string iDeserializer::GenerateLocation() const {
   return ans.substr(0, ans.size()-1);
 }
 
+std::optional<SharedAny> iDeserializer::DeserializeVec() const {
+  const auto n = *size_;
+  if (n < 2 || 4 < n) return std::nullopt;
+
+  double v[4] = {0};
+  for (size_t i = 0; i < n; ++i) {
+    ScopeGuard _(const_cast<iDeserializer*>(this), i);
+
+    auto x = value<double>();
+    if (!x) return std::nullopt;
+    v[i] = *x;
+  }
+  switch (n) {
+  case 2:
+    return Vec2(v[0], v[1]);
+  case 3:
+    return Vec3(v[0], v[1], v[2]);
+  default:
+    return Vec4(v[0], v[1], v[2], v[3]);
+  }
+}
+
 }  // namespace mnian::core
@@ -222,6 +222,27 @@ class iSerializer {
     SerializeKey(key);
     SerializeValue(std::move(value));
   }
+
+  // Serializes vectors as arrays of numbers, and others as FromSharedAny().
+  // iDeserializer::value<SharedAny>() can read both.
+  void SerializeSharedAny(const SharedAny& value) {
+    if (std::holds_alternative<Vec2>(value)) {
+      SerializeVec(std::get<Vec2>(value));
+    } else if (std::holds_alternative<Vec3>(value)) {
+      SerializeVec(std::get<Vec3>(value));
+    } else if (std::holds_alternative<Vec4>(value)) {
+      SerializeVec(std::get<Vec4>(value));
+    } else {
+      SerializeValue(FromSharedAny(value));
+    }
+  }
+
+ private:
+  template <int M>
+  void SerializeVec(const Vec<M>& v) {
+    SerializeArray(static_cast<size_t>(M));
+    for (int i = 0; i < M; ++i) SerializeValue(v[i]);
+  }
 };
 
 
@@ -421,13 +442,15 @@ class iDeserializer {
 
   template <typename T>
   std::optional<T> value() const {
+    if constexpr (std::is_same<T, SharedAny>::value) {
+      if (size_) return DeserializeVec();
+    }
     if (!value_) return std::nullopt;
     return FromAny<T>(*value_);
   }
   template <typename T>
   T value(T def) const {
-    if (!value_) return def;
-    auto ret = FromAny<T>(*value_);
+    auto ret = value<T>();
     return ret? *ret: def;
   }
 
@@ -458,6 +481,10 @@ class iDeserializer {
   }
 
  private:
+  // Reads an array of 2~4 numbers made by iSerializer::SerializeSharedAny().
+  std::optional<SharedAny> DeserializeVec() const;
+
+
   iApp*    app_;
   iLogger* logger_;
 
@@ -0,0 +1,518 @@
+// No copyright
+#include "mncore/task.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>  // NOLINT(build/c++11)
+
+
+namespace mnian::core {
+
+// Parking workers check the queue this number of times before sleeping.
+static constexpr size_t kParkSpinCount = 128;
+
+
+static inline void RelaxCpu() {
+# if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+# else
+    std::this_thread::yield();
+# endif
+}
+
+
+void iTask::Cancel() {
+  if (cancelled_.exchange(true)) return;
+
+  // Walks descendants without recursion. Those already cancelled are skipped
+  // with their subtrees.
+  std::vector<std::shared_ptr<iTask>> stack;
+  CollectChildren(&stack);
+  while (stack.size()) {
+    auto task = std::move(stack.back());
+    stack.pop_back();
+    if (!task->cancelled_.exchange(true)) task->CollectChildren(&stack);
+  }
+}
+
+void iTask::CollectChildren(std::vector<std::shared_ptr<iTask>>* dst) {
+  // Finish() seals the list and then waits for walkers, so the list isn't
+  // deleted while a registered walker sees it unsealed.
+  ++walkers_;
+  for (auto c = children_.load(); c && c != &sealed_; c = c->next) {
+    dst->push_back(c->task);
+  }
+  --walkers_;
+}
+
+
+TaskDeque::TaskDeque(size_t cap) {
+  auto a = std::make_unique<Array>(cap);
+  array_ = a.get();
+  arrays_.push_back(std::move(a));
+}
+
+void TaskDeque::Push(iTask* task) {
+  const auto b = bottom_.load(std::memory_order_relaxed);
+  const auto t = top_.load(std::memory_order_acquire);
+
+  auto a = array_.load(std::memory_order_relaxed);
+  if (static_cast<size_t>(b-t) >= a->cap) {
+    a = Grow(a, b, t);
+  }
+  a->at(b).store(task, std::memory_order_relaxed);
+  bottom_.store(b+1, std::memory_order_release);
+}
+
+iTask* TaskDeque::Pop() {
+  const auto b = bottom_.load(std::memory_order_relaxed) - 1;
+  const auto a = array_.load(std::memory_order_relaxed);
+  bottom_.store(b, std::memory_order_relaxed);
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto t = top_.load(std::memory_order_relaxed);
+
+  if (t > b) {  // empty
+    bottom_.store(b+1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  auto ret = a->at(b).load(std::memory_order_relaxed);
+  if (t == b) {  // the last one, which a thief might be taking
+    if (!top_.compare_exchange_strong(
+            t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      ret = nullptr;
+    }
+    bottom_.store(b+1, std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+iTask* TaskDeque::Steal() {
+  auto t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const auto b = bottom_.load(std::memory_order_acquire);
+  if (t >= b) return nullptr;
+
+  const auto a   = array_.load(std::memory_order_acquire);
+  const auto ret = a->at(t).load(std::memory_order_relaxed);
+  if (!top_.compare_exchange_strong(
+          t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    return nullptr;  // lost the race
+  }
+  return ret;
+}
+
+TaskDeque::Array* TaskDeque::Grow(Array* a, int64_t bottom, int64_t top) {
+  auto next = std::make_unique<Array>(a->cap*2);
+  for (auto i = top; i < bottom; ++i) {
+    next->at(i).store(
+        a->at(i).load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  auto ret = next.get();
+  array_.store(ret, std::memory_order_release);
+  arrays_.push_back(std::move(next));
+  return ret;
+}
+
+
+thread_local TaskQueue::Worker* TaskQueue::Worker::current_ = nullptr;
+
+TaskQueue::Worker::Worker(TaskQueue* q) :
+    q_(q), prev_(current_), interrupts_(q_->interrupts_) {
+  assert(q_);
+
+  std::lock_guard<std::mutex> _(q_->mtx_);
+  if (q_->free_deques_.size()) {
+    index_ = q_->free_deques_.back();
+    q_->free_deques_.pop_back();
+  } else {
+    index_ = q_->deque_count_;
+    assert(index_ < kMaxWorkers);
+
+    q_->deques_[index_] = std::make_unique<TaskDeque>();
+    q_->deque_count_.store(index_+1, std::memory_order_release);
+  }
+  deque_   = q_->deques_[index_].get();
+  current_ = this;
+  ++q_->workers_;
+}
+
+TaskQueue::Worker::~Worker() {
+  assert(current_ == this);
+  current_ = prev_;
+
+  // The request of WakeUp() is done when the last worker leaves, so the queue
+  // stops waking up workers on every time it gets empty.
+  if (!--q_->workers_) q_->waking_ = false;
+
+  // Moves remaining tasks to the shared lane, and returns the deque.
+  std::unique_lock<std::mutex> k(q_->mtx_);
+  size_t n = 0;
+  while (auto task = deque_->Pop()) {
+    q_->PushLane(task);
+    ++n;
+  }
+  q_->free_deques_.push_back(index_);
+  k.unlock();
+
+  if (n) q_->Unpark(n);
+}
+
+bool TaskQueue::Worker::Dequeue() {
+  auto task = q_->PopLane(iTask::kInteractive);
+  if (!task) task = deque_->Pop();
+  if (!task) task = q_->PopLane(iTask::kNormal);
+  if (!task) task = q_->Steal(index_+1);
+  if (!task) task = q_->PopLane(iTask::kBackground);
+  if (!task) return false;
+
+  q_->Exec(task);
+  return true;
+}
+
+void TaskQueue::Worker::Park() {
+  for (size_t i = 0; i < kParkSpinCount; ++i) {
+    if (q_->HasReady()) return;
+    RelaxCpu();
+  }
+
+  // Registers as parking before the last check, so Unpark() called after the
+  // check surely changes the epoch.
+  const auto epoch = q_->epoch_.load();
+  ++q_->parking_;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  const auto interrupts = q_->interrupts_.load();
+  if (interrupts_ == interrupts && !q_->HasReady()) {
+    const auto begin = iTask::Clock::now();
+    q_->epoch_.wait(epoch);
+    q_->metrics_.Park(static_cast<uint64_t>(
+        std::chrono::nanoseconds(iTask::Clock::now() - begin).count()));
+  }
+  interrupts_ = interrupts;
+  --q_->parking_;
+}
+
+
+void TaskQueue::Attach(std::shared_ptr<iTask> task) {
+  assert(task);
+
+  auto ptr = task.get();
+  assert(!ptr->q_);
+
+  ++attached_;
+  ptr->self_ = std::move(task);
+  ptr->q_    = this;
+
+  // When the last dependency is resolved concurrently, either this or
+  // iTask::Release() surely sees the other's change.
+  if (ptr->ready() && !ptr->scheduled_.exchange(true)) Push(ptr);
+}
+
+void TaskQueue::Attach(std::span<const std::shared_ptr<iTask>> tasks) {
+  attached_ += tasks.size();
+
+  const auto now = iTask::Clock::now();
+
+  size_t n = 0;
+  {
+    std::lock_guard<std::mutex> _(mtx_);
+    for (const auto& task : tasks) {
+      auto ptr = task.get();
+      assert(ptr);
+      assert(!ptr->q_);
+
+      ptr->self_ = task;
+      ptr->q_    = this;
+      if (ptr->ready() && !ptr->scheduled_.exchange(true)) {
+        ptr->ready_at_ = now;
+        PushLane(ptr);
+        ++n;
+      }
+    }
+  }
+  if (n) {
+    metrics_.Push(n);
+    Unpark(n);
+  }
+}
+
+bool TaskQueue::Dequeue() {
+  auto task = PopLane(iTask::kInteractive);
+  if (!task) task = PopLane(iTask::kNormal);
+  if (!task) task = Steal(0);
+  if (!task) task = PopLane(iTask::kBackground);
+  if (!task) return false;
+
+  Exec(task);
+  return true;
+}
+
+size_t TaskQueue::Drain(std::chrono::nanoseconds budget) {
+  const auto until = iTask::Clock::now() + budget;
+
+  size_t n = 0;
+  while (iTask::Clock::now() < until && Dequeue()) ++n;
+  return n;
+}
+
+size_t TaskQueue::readyCount() const {
+  size_t n = 0;
+  for (const auto& lane : lanes_) n += lane.size;
+
+  const auto m = deque_count_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < m; ++i) n += deques_[i]->size();
+  return n;
+}
+
+TaskMetrics::Sample TaskQueue::sample() const {
+  TaskMetrics::Sample ret;
+  ret.time_ns = static_cast<uint64_t>(std::chrono::nanoseconds(
+      iTask::Clock::now().time_since_epoch()).count());
+  ret.depth    = readyCount();
+  ret.attached = attached_;
+  ret.workers  = workers_;
+  metrics_.Fill(&ret);
+  return ret;
+}
+
+
+void TaskQueue::Exec(iTask* task) {
+  // The ownership is moved to the local variable, so the task dies after the
+  // execution if no one else refers it.
+  auto self = std::move(task->self_);
+  assert(self);
+
+  if (!--attached_ && waking_) Interrupt();
+
+  const auto begin = iTask::Clock::now();
+  task->Exec();
+  const auto end = iTask::Clock::now();
+
+  metrics_.Exec(
+      static_cast<uint64_t>(
+          std::chrono::nanoseconds(begin - task->ready_at_).count()),
+      static_cast<uint64_t>(std::chrono::nanoseconds(end - begin).count()));
+}
+
+void TaskQueue::Push(iTask* task) {
+  task->ready_at_ = iTask::Clock::now();
+  metrics_.Push();
+
+  auto w = Worker::current_;
+  if (w && w->q_ == this && !task->fifo_ &&
+      task->priority() == iTask::kNormal &&
+      task->deadline() == iTask::Deadline::max()) {
+    w->deque_->Push(task);
+  } else {
+    std::lock_guard<std::mutex> _(mtx_);
+    PushLane(task);
+  }
+  Unpark();
+}
+
+void TaskQueue::PushLane(iTask* task) {
+  auto& lane = lanes_[task->priority()];
+  lane.heap.push_back(Entry {task->deadline(), seq_++, task});
+  std::push_heap(lane.heap.begin(), lane.heap.end());
+  ++lane.size;
+}
+
+iTask* TaskQueue::PopLane(iTask::Priority prio) {
+  auto& lane = lanes_[prio];
+  if (!lane.size) return nullptr;
+
+  std::lock_guard<std::mutex> _(mtx_);
+  if (lane.heap.empty()) return nullptr;
+
+  std::pop_heap(lane.heap.begin(), lane.heap.end());
+  auto ret = lane.heap.back().task;
+  lane.heap.pop_back();
+  --lane.size;
+  return ret;
+}
+
+iTask* TaskQueue::Steal(size_t begin) {
+  const auto n = deque_count_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < n; ++i) {
+    auto ret = deques_[(begin+i)%n]->Steal();
+    if (ret) {
+      metrics_.Steal();
+      return ret;
+    }
+  }
+  return nullptr;
+}
+
+
+void TaskQueue::Unpark(size_t n) {
+  if (notifier_) notifier_();
+
+  // The pushed task must be visible before checking parking workers, and this
+  // pairs with the increment of parking_ in Worker::Park().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!parking_) return;
+
+  ++epoch_;
+  if (n > 1) {
+    epoch_.notify_all();
+  } else {
+    epoch_.notify_one();
+  }
+}
+
+bool TaskQueue::HasReady() const {
+  for (const auto& lane : lanes_) {
+    if (lane.size) return true;
+  }
+
+  const auto n = deque_count_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < n; ++i) {
+    if (!deques_[i]->empty()) return true;
+  }
+  return false;
+}
+
+
+
+void iCoLambda::DoExec() {
+  co_ = DoCoExec().Release();
+  assert(co_);
+
+  co_.promise().owner = this;
+  current_ = queue();
+
+  // The lambda is finished when the body reaches the end.
+  Defer();
+  co_.resume();
+}
+
+void iCoLambda::Schedule(
+    TaskQueue* q, std::shared_ptr<iTask> wait, bool yield) {
+  current_ = q;
+
+  auto task = MakePooled<Resumer>(
+      std::static_pointer_cast<iCoLambda>(shared_from_this()), yield);
+  task->priority(priority());
+  if (wait) wait->AddChild(task);
+
+  q->Attach(task);
+  task->Trigger();
+}
+
+
+namespace {
+
+// A task depending on all leaves of a graph, which fulfills the promise.
+class GraphSink final : public iTask {
+ public:
+  GraphSink() = default;
+
+  GraphSink(const GraphSink&) = delete;
+  GraphSink(GraphSink&&) = delete;
+
+  GraphSink& operator=(const GraphSink&) = delete;
+  GraphSink& operator=(GraphSink&&) = delete;
+
+
+  std::future<void> future() {
+    return promise_.get_future();
+  }
+
+ protected:
+  void DoExec() override {
+    promise_.set_value();
+  }
+  void DoCancel() override {
+    promise_.set_exception(std::make_exception_ptr(CancelledError()));
+  }
+
+ private:
+  std::promise<void> promise_;
+};
+
+}  // namespace
+
+
+bool TaskGraph::Validate() const {
+  // Kahn's algorithm: all nodes are visited only if there's no cycle.
+  std::vector<size_t> deps(nodes_.size());
+  std::vector<std::vector<size_t>> children(nodes_.size());
+  for (const auto& e : edges_) {
+    ++deps[e.child];
+    children[e.parent].push_back(e.child);
+  }
+
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    if (!deps[i]) ready.push_back(i);
+  }
+
+  size_t visited = 0;
+  while (ready.size()) {
+    const auto i = ready.back();
+    ready.pop_back();
+    ++visited;
+
+    for (auto c : children[i]) {
+      if (!--deps[c]) ready.push_back(c);
+    }
+  }
+  return visited == nodes_.size();
+}
+
+std::future<void> TaskGraph::Submit(TaskQueue* q) {
+  assert(q);
+
+  if (!Validate()) {
+    nodes_.clear();
+    edges_.clear();
+
+    // None of nodes in a cycle would get ready.
+    std::promise<void> promise;
+    promise.set_exception(std::make_exception_ptr(
+        std::invalid_argument("TaskGraph has a cycle")));
+    return promise.get_future();
+  }
+
+  // The sink depends on all leaves to fulfill the promise.
+  auto sink = MakePooled<GraphSink>();
+  auto ret  = sink->future();
+
+  std::vector<bool> has_child(nodes_.size());
+  for (const auto& e : edges_) {
+    auto& parent = nodes_[e.parent];
+    auto& child  = nodes_[e.child];
+    if (e.connect) {
+      parent.lambda->Connect(
+          e.out_i, std::static_pointer_cast<iLambda>(child.task), e.in_i);
+    } else {
+      parent.task->AddChild(child.task);
+    }
+    has_child[e.parent] = true;
+  }
+
+  std::vector<std::shared_ptr<iTask>> tasks;
+  tasks.reserve(nodes_.size()+1);
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    auto& task = nodes_[i].task;
+    if (!has_child[i]) task->AddChild(sink);
+    task->Trigger();
+    tasks.push_back(std::move(task));
+  }
+  sink->Trigger();
+  tasks.push_back(std::move(sink));
+
+  // Tasks are triggered before attached, so no task is executed until all of
+  // them are attached.
+  q->Attach(tasks);
+
+  nodes_.clear();
+  edges_.clear();
+  return ret;
+}
+
+}  // namespace mnian::core
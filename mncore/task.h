@@ -3,24 +3,71 @@
 // Simple task queue implementation.
 #pragma once
 
-#include <algorithm>
+#include <array>
+#include <atomic>  // NOLINT(build/c++11)
 #include <cassert>
 #include <chrono>  // NOLINT(build/c++11)
-#include <condition_variable>  // NOLINT(build/c++11)
-#include <functional>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <future>
 #include <memory>
 #include <mutex>  // NOLINT(build/c++11)
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "mncore/conv.h"
+#include "mncore/function.h"
+#include "mncore/metrics.h"
+#include "mncore/pool.h"
 
 
 namespace mnian::core {
 
-class iTask {
+class TaskQueue;
+
+
+// CancelToken is shared by tasks which should be cancelled together.
+class CancelToken final {
+ public:
+  CancelToken() = default;
+
+  CancelToken(const CancelToken&) = delete;
+  CancelToken(CancelToken&&) = delete;
+
+  CancelToken& operator=(const CancelToken&) = delete;
+  CancelToken& operator=(CancelToken&&) = delete;
+
+
+  void Cancel() {
+    cancelled_ = true;
+  }
+
+  bool cancelled() const {
+    return cancelled_;
+  }
+
+ private:
+  std::atomic<bool> cancelled_ = false;
+};
+
+// CancelledError is stored in futures of tasks which are cancelled.
+class CancelledError final : public std::runtime_error {
+ public:
+  CancelledError() : std::runtime_error("task cancelled") {
+  }
+};
+
+
+// An interface of task, whose all methods are lock-free. A task becomes ready
+// when it's triggered and all parents are done, and is executed once by the
+// queue attached.
+class iTask : public std::enable_shared_from_this<iTask> {
  public:
   friend class TaskQueue;
 
@@ -31,9 +78,34 @@ class iTask {
     kDone,
   };
 
+  // Ready tasks with higher priority are always executed earlier.
+  enum Priority {
+    kInteractive,
+    kNormal,
+    kBackground,
+  };
+  static constexpr size_t kPriorityCount = 3;
+
+  using Clock    = std::chrono::steady_clock;
+  using Deadline = Clock::time_point;
+
 
   iTask() = default;
-  virtual ~iTask() = default;
+  virtual ~iTask() {
+    auto c = children_.load(std::memory_order_relaxed);
+    while (c && c != &sealed_) {
+      auto next = c->next;
+      delete c;
+      c = next;
+    }
+
+    auto p = parents_.load(std::memory_order_relaxed);
+    while (p) {
+      auto next = p->next;
+      delete p;
+      p = next;
+    }
+  }
 
   iTask(const iTask&) = delete;
   iTask(iTask&&) = delete;
@@ -45,69 +117,253 @@ class iTask {
   // Triggers this task. After this, the task is ready when all dependencies
   // are resolved.
   void Trigger() {
-    std::lock_guard<std::mutex> _(mtx_);
-    if (state_ != kInitial) return;
-
-    --deps_;
-    state_ = kTriggered;
+    auto expect = kInitial;
+    if (!state_.compare_exchange_strong(expect, kTriggered)) return;
+    Release();
   }
 
   // Makes `child` to depend `this`. `this` can be in state kDone.
   void AddChild(std::shared_ptr<iTask> child) {
-    std::lock_guard<std::mutex> _(mtx_);
-    if (state_ == kDone) return;
+    auto head = children_.load(std::memory_order_acquire);
+    if (head == &sealed_) return;
+
+    auto ptr = child.get();
+    ++ptr->deps_;
+
+    auto c = new Child {std::move(child), head};
+    while (!children_.compare_exchange_weak(c->next, c)) {
+      if (c->next == &sealed_) {
+        // This task has been done while appending.
+        delete c;
+        ptr->Release();
+        return;
+      }
+    }
 
-    ++child->deps_;
-    children_.push_back(std::move(child));
+    // Records the parent to propagate priority boosts to ancestors.
+    auto self = weak_from_this();
+    if (!self.expired()) {
+      auto p = new Parent {std::move(self), ptr->parents_.load()};
+      while (!ptr->parents_.compare_exchange_weak(p->next, p)) continue;
+    }
+    Boost(ptr->priority());
   }
 
 
-  bool ready() {
-    std::lock_guard<std::mutex> _(mtx_);
+  // Requests to cancel this task and all of its descendants at once, so they
+  // are skipped as soon as they get ready. A cancelled task calls DoCancel()
+  // instead of DoExec() if it hasn't started yet. The running task can poll
+  // cancelled() to stop. Children added after this are cancelled when this is
+  // done.
+  void Cancel();
+
+
+  bool ready() const {
     return deps_ == 0;
   }
+  State state() const {
+    return state_;
+  }
+  TaskQueue* queue() const {
+    return q_;
+  }
+
+  // The token must be set before the task gets ready.
+  void token(std::shared_ptr<CancelToken> t) {
+    assert(!ready());
+    token_ = std::move(t);
+  }
+  bool cancelled() const {
+    return cancelled_ || (token_ && token_->cancelled());
+  }
+
+  // Changes the priority. When the priority gets higher, all ancestors are also
+  // boosted. This doesn't affect tasks which has got ready already.
+  void priority(Priority p) {
+    const auto prev = priority_.exchange(p);
+    if (p < prev) BoostParents(p);
+  }
+  Priority priority() const {
+    return priority_;
+  }
+
+  // Tasks with the same priority are executed in order of deadline. This must
+  // be called before the task gets ready.
+  void deadline(Deadline d) {
+    assert(!ready());
+    deadline_ = d;
+  }
+  Deadline deadline() const {
+    return deadline_;
+  }
 
  protected:
   virtual void DoExec() = 0;
 
- private:
-  void Resolve() {
-    std::lock_guard<std::mutex> _(mtx_);
-    assert(deps_);
+  // Be called instead of DoExec() when the task is cancelled before it starts.
+  virtual void DoCancel() {
+  }
 
-    --deps_;
+  // Be called after DoExec() or DoCancel(), and before children are resolved.
+  virtual void DoFinish() {
   }
 
-  void Exec() {
-    {
-      std::lock_guard<std::mutex> _(mtx_);
-      if (state_ != kTriggered) return;
+
+  // Makes the task be pushed to the shared lane even when it gets ready on a
+  // worker, so it's executed after tasks got ready earlier on the worker. This
+  // must be called before the task gets ready.
+  void fifo(bool v) {
+    assert(!ready());
+    fifo_ = v;
+  }
+
+
+  // Makes the task not be done when DoExec() returns. Finish() must be called
+  // later instead, possibly on other thread.
+  void Defer() {
+    deferred_ = true;
+  }
+
+  // Marks the task done and resolves its children.
+  void Finish() {
+    DoFinish();
+    state_ = kDone;
+
+    // The cancellation requested while executing is also propagated.
+    const bool cancel = cancelled();
+
+    // Seals the list and reverses it to resolve children in order of addition.
+    // Cancel() might be walking the list on other threads, so the list is
+    // touched after they leave.
+    auto c = children_.exchange(&sealed_);
+    while (walkers_) continue;
+
+    Child* list = nullptr;
+    while (c) {
+      auto next = c->next;
+      c->next = list;
+      list    = c;
+      c       = next;
+    }
+    while (list) {
+      auto next = list->next;
+      if (cancel) list->task->Cancel();
+      list->task->Release();
+      delete list;
+      list = next;
+    }
+  }
+
+ private:
+  struct Child final {
+   public:
+    static void* operator new(size_t n) {
+      return Pool::Allocate(n);
+    }
+    static void operator delete(void* ptr, size_t n) {
+      Pool::Deallocate(ptr, n);
+    }
+
+    std::shared_ptr<iTask> task;
+
+    Child* next;
+  };
+
+  // A list of children is replaced with this after the task is done, to make
+  // AddChild() know that.
+  static inline Child sealed_ = {nullptr, nullptr};
+
+  struct Parent final {
+   public:
+    static void* operator new(size_t n) {
+      return Pool::Allocate(n);
     }
-    DoExec();
-    {
-      std::lock_guard<std::mutex> _(mtx_);
-      state_ = kDone;
-      for (auto& child : children_) {
-        child->Resolve();
+    static void operator delete(void* ptr, size_t n) {
+      Pool::Deallocate(ptr, n);
+    }
+
+    std::weak_ptr<iTask> task;
+
+    Parent* next;
+  };
+
+
+  void Boost(Priority p) {
+    auto prev = priority_.load();
+    while (p < prev) {
+      if (priority_.compare_exchange_weak(prev, p)) {
+        BoostParents(p);
+        return;
       }
-      children_.clear();
+    }
+  }
+  void BoostParents(Priority p) {
+    if (state_ == kDone) return;
+    for (auto itr = parents_.load(); itr; itr = itr->next) {
+      if (auto parent = itr->task.lock()) parent->Boost(p);
     }
   }
 
 
-  std::mutex mtx_;
+  // Decrements the dependency counter and passes this task to the attached
+  // queue when it reaches zero.
+  inline void Release();
+
+  // Appends all children to `dst` unless the list is sealed.
+  void CollectChildren(std::vector<std::shared_ptr<iTask>>* dst);
+
+  void Exec() {
+    if (state_ != kTriggered) return;
+    if (cancelled()) {
+      DoCancel();
+    } else {
+      DoExec();
+    }
+    if (!deferred_) Finish();
+  }
+
+
+  std::atomic<State> state_ = kInitial;
+
+  // The trigger is also counted as a dependency.
+  std::atomic<size_t> deps_ = size_t{1};
+
+  std::atomic<Child*> children_ = nullptr;
+
+  // a number of threads walking the children in Cancel()
+  std::atomic<size_t> walkers_ = 0;
+
+  std::atomic<Parent*> parents_ = nullptr;
+
+  std::atomic<Priority> priority_ = kNormal;
 
-  std::vector<std::shared_ptr<iTask>> children_;
+  std::atomic<bool> cancelled_ = false;
 
-  State state_ = kInitial;
+  std::shared_ptr<CancelToken> token_;
 
-  size_t deps_ = size_t{1};
+  Deadline deadline_ = Deadline::max();
+
+  // when the task was pushed to the queue, for metrics
+  Clock::time_point ready_at_;
+
+  // The queue that this task is attached to, and the ownership held until
+  // the queue executes this. The flag prevents the task from being pushed to
+  // the queue twice by Attach() and Release() racing.
+  std::atomic<TaskQueue*> q_ = nullptr;
+
+  std::shared_ptr<iTask> self_;
+
+  bool deferred_ = false;
+
+  bool fifo_ = false;
+
+  std::atomic<bool> scheduled_ = false;
 };
 
 
 class Task : public iTask {
  public:
-  using F = std::function<void(void)>;
+  using F = SmallFunction<void(void)>;
 
 
   Task() = delete;
@@ -124,14 +380,33 @@ class Task : public iTask {
   void DoExec() override {
     func_();
   }
+  void DoCancel() override {
+    // Values captured are released right now, instead of when the task dies.
+    func_ = F();
+  }
 
  private:
   F func_;
 };
 
 
+// An interface of task that takes inputs and produces outputs. Inputs must be
+// set before the lambda is triggered, and outputs are passed to inputs of
+// connected lambdas when the execution is done, so no lock is needed.
+//
+// Each value is published once as an immutable Value, and connected inputs
+// share it without copying.
 class iLambda : public iTask {
  public:
+  using Value = std::shared_ptr<const SharedAny>;
+
+
+  // Allocates new Value from Pool.
+  static Value MakeValue(SharedAny&& v) {
+    return MakePooled<SharedAny>(std::move(v));
+  }
+
+
   iLambda() = delete;
   iLambda(size_t in, size_t out) : in_(in), out_(out) {
   }
@@ -143,35 +418,50 @@ class iLambda : public iTask {
   iLambda& operator=(iLambda&&) = delete;
 
 
+  // `this` can be in any state but `in` must not be triggered yet.
   void Connect(size_t out_i, std::shared_ptr<iLambda> in, size_t in_i) {
     assert(in);
+    assert(in->state() == kInitial);
 
-    std::lock_guard<std::mutex> _(mtx_);
-    out_[out_i].Connect(&in->in_[in_i]);
+    auto& out = out_[out_i];
+    auto& dst = in->in_[in_i];
+    if (!out.Connect(&dst)) {
+      // The output is already fixed.
+      dst.Set(Value(out.value()));
+    }
     AddChild(std::move(in));
   }
 
 
   template <typename T>
   void in(size_t i, T&& value) {
-    std::lock_guard<std::mutex> _(mtx_);
-    return in_[i].Set(std::move(value));
+    in(i, MakeValue(SharedAny(std::forward<T>(value))));
+  }
+  void in(size_t i, Value value) {
+    assert(state() == kInitial);
+    in_[i].Set(std::move(value));
   }
 
  protected:
   const SharedAny& in(size_t i) {
-    std::lock_guard<std::mutex> _(mtx_);
-    return in_[i].value();
+    return in_[i].get();
   }
   template <typename T>
   const T& in(size_t i) {
-    std::lock_guard<std::mutex> _(mtx_);
-    return std::get<T>(in_[i].value());
+    return std::get<T>(in_[i].get());
+  }
+
+  // Returns the handle of input value, which can be held after the execution
+  // or passed to an output without copying.
+  const Value& inRef(size_t i) {
+    return in_[i].value();
   }
 
   template <typename T>
   void out(size_t i, T&& value) {
-    std::lock_guard<std::mutex> _(mtx_);
+    out(i, MakeValue(SharedAny(std::forward<T>(value))));
+  }
+  void out(size_t i, Value value) {
     out_[i].Set(std::move(value));
   }
 
@@ -187,59 +477,253 @@ class iLambda : public iTask {
     In& operator=(In&&) = default;
 
 
-    void Set(SharedAny&& value) {
+    void Set(Value&& value) {
       value_ = std::move(value);
     }
 
-    const SharedAny& value() const {
+    const SharedAny& get() const {
+      return value_? *value_: kEmpty;
+    }
+    const Value& value() const {
       return value_;
     }
 
    private:
-    SharedAny value_;
+    static inline const SharedAny kEmpty = {};
+
+
+    Value value_;
   };
 
+  // Out holds a lock-free list of connected inputs, which is sealed by Fix()
+  // like children of iTask.
   class Out final {
    public:
     Out() = default;
+    ~Out() {
+      auto link = links_.load(std::memory_order_relaxed);
+      while (link && link != &sealed_) {
+        auto next = link->next;
+        delete link;
+        link = next;
+      }
+    }
 
     Out(const Out&) = delete;
-    Out(Out&&) = default;
+    Out(Out&&) = delete;
 
     Out& operator=(const Out&) = delete;
-    Out& operator=(Out&&) = default;
+    Out& operator=(Out&&) = delete;
 
 
-    void Connect(In* in) {
+    // Returns false if the output has been fixed already.
+    bool Connect(In* in) {
       assert(in);
 
-      in->Set(SharedAny(value_));
-      in_.push_back(in);
+      auto link = new Link {in, links_.load()};
+      while (link->next != &sealed_) {
+        if (links_.compare_exchange_weak(link->next, link)) return true;
+      }
+      delete link;
+      return false;
     }
 
-    void Set(SharedAny&& value) {
-      value_ = std::move(value);
-      for (auto& in : in_) {
-        in->Set(SharedAny(value_));
+    // Passes the value to all inputs connected, and refuses new connections.
+    void Fix() {
+      auto link = links_.exchange(&sealed_);
+      while (link) {
+        link->in->Set(Value(value_));
+
+        auto next = link->next;
+        delete link;
+        link = next;
       }
     }
 
+    void Set(Value&& value) {
+      value_ = std::move(value);
+    }
+
+    const Value& value() const {
+      return value_;
+    }
+
    private:
-    std::vector<In*> in_;
+    struct Link final {
+     public:
+      static void* operator new(size_t n) {
+        return Pool::Allocate(n);
+      }
+      static void operator delete(void* ptr, size_t n) {
+        Pool::Deallocate(ptr, n);
+      }
+
+      In* in;
+
+      Link* next;
+    };
+
+    static inline Link sealed_ = {nullptr, nullptr};
+
 
-    SharedAny value_;
+    std::atomic<Link*> links_ = nullptr;
+
+    Value value_;
   };
 
 
-  std::mutex mtx_;
+  void DoFinish() override {
+    // Values of cancelled lambda are no longer used, so they are released
+    // right now, instead of when the lambda dies.
+    if (cancelled()) {
+      for (auto& in : in_) in.Set(nullptr);
+      for (auto& out : out_) out.Set(nullptr);
+    }
+    for (auto& out : out_) out.Fix();
+  }
+
 
-  std::vector<In>  in_;
-  std::vector<Out> out_;
+  std::vector<In,  PoolAllocator<In>>  in_;
+  std::vector<Out, PoolAllocator<Out>> out_;
 };
 
 
+// TaskDeque is a lock-free work-stealing deque of tasks (Chase-Lev). Only the
+// owner thread can call Push() and Pop(), which work on the bottom end, and
+// any thread can call Steal(), which takes from the top end.
+class TaskDeque final {
+ public:
+  TaskDeque() : TaskDeque(size_t{64}) {
+  }
+  explicit TaskDeque(size_t cap);
+
+  TaskDeque(const TaskDeque&) = delete;
+  TaskDeque(TaskDeque&&) = delete;
+
+  TaskDeque& operator=(const TaskDeque&) = delete;
+  TaskDeque& operator=(TaskDeque&&) = delete;
+
+
+  void Push(iTask* task);
+  iTask* Pop();
+  iTask* Steal();
+
+
+  // The value might be already outdated when it's returned.
+  bool empty() const {
+    return size() == 0;
+  }
+  size_t size() const {
+    const auto b = bottom_.load(std::memory_order_relaxed);
+    const auto t = top_.load(std::memory_order_relaxed);
+    return b > t? static_cast<size_t>(b-t): 0;
+  }
+
+ private:
+  struct Array final {
+   public:
+    explicit Array(size_t n) : cap(n), mask(n-1), buf(new Item[n]) {
+      assert((n & mask) == 0);
+    }
+
+    using Item = std::atomic<iTask*>;
+
+    Item& at(int64_t i) const {
+      return buf[static_cast<size_t>(i) & mask];
+    }
+
+    const size_t cap;
+    const size_t mask;
+
+    std::unique_ptr<Item[]> buf;
+  };
+
+  Array* Grow(Array* a, int64_t bottom, int64_t top);
+
+
+  std::atomic<int64_t> top_    = 0;
+  std::atomic<int64_t> bottom_ = 0;
+
+  std::atomic<Array*> array_;
+
+  // Arrays replaced by Grow() might be still read by thieves, so they are
+  // kept until the deque dies.
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+
+// TaskQueue holds tasks attached until they get ready, and executes them in
+// order of getting ready. Tasks that are not ready yet are never touched by
+// Dequeue().
+//
+// Threads registered as Worker own a TaskDeque each. Tasks got ready on a
+// worker thread (e.g. children released by the task just executed) are pushed
+// to its own deque, and idle workers steal them from others. Tasks got ready
+// on other threads are pushed to a shared lane.
+//
+// Each priority has its own shared lane, where tasks are ordered by deadline
+// and then by order of getting ready. Only tasks with normal priority and no
+// deadline use the worker's deque, so interactive tasks never wait behind
+// normal ones, and background tasks are executed only when nothing else is
+// ready. Tasks marked as fifo also skip the deque, since it pops the newest
+// first.
 class TaskQueue final {
  public:
+  friend class iTask;
+
+
+  static constexpr size_t kMaxWorkers = 256;
+
+
+  // Worker represents a thread executing tasks of the queue, and must be
+  // created and destroyed on the thread.
+  class Worker final {
+   public:
+    friend class TaskQueue;
+
+
+    Worker() = delete;
+    explicit Worker(TaskQueue* q);
+    ~Worker();
+
+    Worker(const Worker&) = delete;
+    Worker(Worker&&) = delete;
+
+    Worker& operator=(const Worker&) = delete;
+    Worker& operator=(Worker&&) = delete;
+
+
+    // Executes one task popped from the interactive lane, own deque, the
+    // normal lane, other workers' deques, or the background lane, in that
+    // order. Returns true if such task is found.
+    bool Dequeue();
+
+    // Blocks the current thread until any task gets ready, or WakeUp() is
+    // called. The thread spins for a while before falling asleep, and the
+    // sleeping thread costs no CPU time.
+    void Park();
+
+
+    size_t index() const {
+      return index_;
+    }
+
+   private:
+    static thread_local Worker* current_;
+
+
+    TaskQueue* q_;
+
+    Worker* prev_;
+
+    size_t index_;
+
+    TaskDeque* deque_;
+
+    uint32_t interrupts_;
+  };
+
+
   TaskQueue() = default;
 
   TaskQueue(const TaskQueue&) = delete;
@@ -250,69 +734,444 @@ class TaskQueue final {
 
 
   // Each of attached tasks will be executed by Dequeue() after it's ready.
-  void Attach(std::shared_ptr<iTask> task) {
-    assert(task);
+  void Attach(std::shared_ptr<iTask> task);
 
-    std::lock_guard<std::mutex> _(mtx_);
-    tasks_.push_back(std::move(task));
+  // Attaches all tasks at once. Tasks ready at this time are pushed with a
+  // single lock, and parking workers are woken up once.
+  void Attach(std::span<const std::shared_ptr<iTask>> tasks);
 
-    cv_.notify_all();
-  }
-
-  // Creates and Attaches new task that executes the passed function.
+  // Creates and Attaches new task that executes the passed function. The task
+  // is allocated from Pool.
   void Exec(Task::F&& func) {
-    auto task = std::make_shared<Task>(std::move(func));
+    auto task = MakePooled<Task>(std::move(func));
     Attach(task);
     task->Trigger();
   }
 
-  // Dequeues and Executes one of tasks whose ready() is true. Returns
-  // true if such task is found, otherwise false.
-  bool Dequeue() {
-    std::shared_ptr<iTask> task;
-    {
-      std::lock_guard<std::mutex> _(mtx_);
+  // Dequeues and Executes one of ready tasks from the shared lanes, or steals
+  // from workers. Returns true if such task is found, otherwise false.
+  bool Dequeue();
 
-      auto itr = std::find_if(tasks_.begin(), tasks_.end(),
-                              [](auto& x) { return x->ready(); });
-      if (itr == tasks_.end()) return false;
+  // Dequeues and executes ready tasks until no task is ready or the time
+  // budget runs out. Returns a number of tasks executed.
+  size_t Drain(std::chrono::nanoseconds budget);
+
+  // Wakes up all workers parking forcibly. Each worker returns from Park()
+  // once even if it starts parking after this call. Since this is usually
+  // called to stop workers, they are also woken up whenever the queue gets
+  // empty, until all workers are destroyed.
+  void WakeUp() {
+    waking_ = true;
+    Interrupt();
+  }
+
+
+  // Sets a function called whenever tasks get ready, to wake up a thread
+  // waiting for other events. It's called on various threads so must be
+  // thread-safe, and must be set before any task is attached.
+  void notifier(Task::F&& f) {
+    notifier_ = std::move(f);
+  }
+
+  // Returns a number of tasks attached and not dequeued yet.
+  size_t size() const {
+    return attached_;
+  }
 
-      task = std::move(*itr);
-      tasks_.erase(itr);
+  // Returns a number of ready tasks not dequeued yet. The value might be
+  // already outdated when it's returned.
+  size_t readyCount() const;
+
+  // Takes a sample of metrics without any lock.
+  TaskMetrics::Sample sample() const;
+
+ private:
+  // Takes the ownership of the task from itself and executes it.
+  void Exec(iTask* task);
+
+  void Push(iTask* task);
+
+  iTask* PopLane(iTask::Priority prio);
+  iTask* Steal(size_t begin);
+
+  // Wakes up parking workers if exist, for `n` tasks pushed.
+  void Unpark(size_t n = 1);
+
+  void Interrupt() {
+    ++interrupts_;
+    ++epoch_;
+    epoch_.notify_all();
+  }
+
+  bool HasReady() const;
+
+
+  struct Entry final {
+   public:
+    // Used as a comparator of heap, which puts the earliest on the top.
+    bool operator<(const Entry& other) const {
+      if (deadline != other.deadline) return deadline > other.deadline;
+      return seq > other.seq;
     }
-    task->Exec();
 
-    std::lock_guard<std::mutex> _(mtx_);
-    cv_.notify_all();
-    return true;
+    iTask::Deadline deadline;
+
+    uint64_t seq;
+
+    iTask* task;
+  };
+  struct Lane final {
+   public:
+    std::vector<Entry, PoolAllocator<Entry>> heap;
+
+    std::atomic<size_t> size = 0;
+  };
+
+  // Pushes the task to the lane. mtx_ must be locked.
+  void PushLane(iTask* task);
+
+
+  std::mutex mtx_;
+
+  std::array<Lane, iTask::kPriorityCount> lanes_;
+
+  uint64_t seq_ = 0;
+
+  std::atomic<size_t> attached_ = 0;
+
+  std::atomic<size_t> workers_ = 0;
+
+  TaskMetrics metrics_;
+
+
+  // Deques are never deleted until the queue dies because thieves might be
+  // accessing them, but an index is reused after its Worker is destroyed.
+  std::array<std::unique_ptr<TaskDeque>, kMaxWorkers> deques_;
+
+  std::atomic<size_t> deque_count_ = 0;
+
+  std::vector<size_t> free_deques_;
+
+
+  // Parking workers sleep on the epoch which is incremented by Unpark() and
+  // WakeUp(), like an eventcount.
+  std::atomic<uint32_t> epoch_      = 0;
+  std::atomic<uint32_t> parking_    = 0;
+  std::atomic<uint32_t> interrupts_ = 0;
+
+  std::atomic<bool> waking_ = false;
+
+  Task::F notifier_;
+};
+
+
+// iCoLambda is a lambda whose body is a coroutine. The body can await other
+// tasks, move to other queues, and yield to other tasks without blocking the
+// thread, and the lambda is done when the body returns.
+class iCoLambda : public iLambda {
+ public:
+  class Coroutine;
+
+
+  iCoLambda() = delete;
+  iCoLambda(size_t in, size_t out) : iLambda(in, out) {
+  }
+  ~iCoLambda() {
+    if (co_) co_.destroy();
   }
 
-  // Wakes up threads sleeping by Sleep() forcibly.
-  void WakeUp() {
-    std::lock_guard<std::mutex> _(mtx_);
-    cv_.notify_all();
+  iCoLambda(const iCoLambda&) = delete;
+  iCoLambda(iCoLambda&&) = delete;
+
+  iCoLambda& operator=(const iCoLambda&) = delete;
+  iCoLambda& operator=(iCoLambda&&) = delete;
+
+ protected:
+  class Awaiter;
+
+
+  virtual Coroutine DoCoExec() = 0;
+
+
+  // Suspends the body until the task is done. The task must be attached to a
+  // queue and triggered by the caller.
+  inline Awaiter Await(std::shared_ptr<iTask> task);
+
+  // Suspends the body and resumes it on the queue.
+  inline Awaiter ResumeOn(TaskQueue* q);
+
+  // Suspends the body and resumes it after tasks ready on the current queue.
+  inline Awaiter Yield();
+
+ private:
+  class Promise;
+  using Handle = std::coroutine_handle<Promise>;
+
+
+  class Resumer;
+
+
+  void DoExec() final;
+
+  // Attaches a task resuming the body to the queue. When `wait` is not null,
+  // the task waits for it. A task for yielding is executed after tasks ready
+  // now, even on a worker.
+  void Schedule(TaskQueue* q, std::shared_ptr<iTask> wait, bool yield);
+
+
+  Handle co_;
+
+  // The queue which the body is running on.
+  TaskQueue* current_ = nullptr;
+};
+
+class iCoLambda::Promise final {
+ public:
+  class FinalAwaiter final {
+   public:
+    bool await_ready() noexcept {
+      return false;
+    }
+    void await_suspend(Handle h) noexcept {
+      h.promise().owner->Finish();
+    }
+    void await_resume() noexcept {
+    }
+  };
+
+
+  static void* operator new(size_t n) {
+    return Pool::Allocate(n);
+  }
+  static void operator delete(void* ptr, size_t n) {
+    Pool::Deallocate(ptr, n);
   }
 
-  // Blocks the current thread until WakeUp() called, timeout elapsed, or
-  // the queue changed.
-  template <typename Rep, typename Period>
-  void Sleep(const std::chrono::duration<Rep, Period>& timeout) {
-    std::unique_lock<std::mutex> k(mtx_);
-    cv_.wait_for(k, timeout);
+
+  inline Coroutine get_return_object();
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+  FinalAwaiter final_suspend() noexcept {
+    return {};
+  }
+
+  void return_void() {
+  }
+  void unhandled_exception() {
+    std::terminate();
   }
 
 
-  size_t size() {
-    std::lock_guard<std::mutex> _(mtx_);
-    return tasks_.size();
+  iCoLambda* owner = nullptr;
+};
+
+class iCoLambda::Coroutine final {
+ public:
+  using promise_type = Promise;
+
+
+  Coroutine() = delete;
+  explicit Coroutine(Handle h) : h_(h) {
+  }
+  ~Coroutine() {
+    if (h_) h_.destroy();
+  }
+
+  Coroutine(const Coroutine&) = delete;
+  Coroutine(Coroutine&& src) : h_(std::exchange(src.h_, nullptr)) {
+  }
+
+  Coroutine& operator=(const Coroutine&) = delete;
+  Coroutine& operator=(Coroutine&&) = delete;
+
+
+  Handle Release() {
+    return std::exchange(h_, nullptr);
   }
 
  private:
-  std::mutex mtx_;
+  Handle h_;
+};
+
+class iCoLambda::Awaiter final {
+ public:
+  Awaiter() = delete;
+  Awaiter(iCoLambda*            owner,
+          TaskQueue*            q,
+          std::shared_ptr<iTask> wait,
+          bool                  yield = false) :
+      owner_(owner), q_(q), wait_(std::move(wait)), yield_(yield) {
+    assert(owner_);
+    assert(q_);
+  }
+
+  Awaiter(const Awaiter&) = delete;
+  Awaiter(Awaiter&&) = default;
+
+  Awaiter& operator=(const Awaiter&) = delete;
+  Awaiter& operator=(Awaiter&&) = delete;
+
+
+  bool await_ready() {
+    return false;
+  }
+  void await_suspend(Handle) {
+    // The body might be resumed on other thread before this returns, so
+    // nothing can be touched after scheduling.
+    owner_->Schedule(q_, std::move(wait_), yield_);
+  }
+  void await_resume() {
+  }
+
+ private:
+  iCoLambda* owner_;
+
+  TaskQueue* q_;
+
+  std::shared_ptr<iTask> wait_;
+
+  bool yield_;
+};
+
+// A task resuming the body. The body is resumed even if the task is cancelled
+// by what the body is waiting for, since the lambda can't be done otherwise.
+class iCoLambda::Resumer final : public iTask {
+ public:
+  Resumer() = delete;
+  Resumer(std::shared_ptr<iCoLambda> owner, bool yield) :
+      owner_(std::move(owner)) {
+    fifo(yield);
+  }
 
-  std::condition_variable cv_;
+  Resumer(const Resumer&) = delete;
+  Resumer(Resumer&&) = delete;
 
-  std::vector<std::shared_ptr<iTask>> tasks_;
+  Resumer& operator=(const Resumer&) = delete;
+  Resumer& operator=(Resumer&&) = delete;
+
+ protected:
+  void DoExec() override {
+    owner_->co_.resume();
+  }
+  void DoCancel() override {
+    owner_->co_.resume();
+  }
+
+ private:
+  std::shared_ptr<iCoLambda> owner_;
 };
 
+iCoLambda::Coroutine iCoLambda::Promise::get_return_object() {
+  return Coroutine(Handle::from_promise(*this));
+}
+
+iCoLambda::Awaiter iCoLambda::Await(std::shared_ptr<iTask> task) {
+  assert(task);
+  return Awaiter(this, current_, std::move(task));
+}
+iCoLambda::Awaiter iCoLambda::ResumeOn(TaskQueue* q) {
+  return Awaiter(this, q, nullptr);
+}
+iCoLambda::Awaiter iCoLambda::Yield() {
+  return Awaiter(this, current_, nullptr, true);
+}
+
+
+// TaskGraph collects tasks and dependencies between them, and submits all of
+// them to a queue in one operation, so workers never see a graph partially
+// wired.
+class TaskGraph final {
+ public:
+  TaskGraph() = default;
+
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph(TaskGraph&&) = default;
+
+  TaskGraph& operator=(const TaskGraph&) = delete;
+  TaskGraph& operator=(TaskGraph&&) = default;
+
+
+  // Adds a task which must be in state kInitial and not attached, and returns
+  // its index.
+  template <typename T>
+  size_t Add(std::shared_ptr<T> task) {
+    static_assert(std::is_base_of_v<iTask, T>);
+    assert(task);
+    assert(task->state() == iTask::kInitial);
+
+    iLambda* lambda = nullptr;
+    if constexpr (std::is_base_of_v<iLambda, T>) lambda = task.get();
+
+    nodes_.push_back(Node {std::move(task), lambda});
+    return nodes_.size()-1;
+  }
+
+  // Makes the child depend on the parent.
+  void AddEdge(size_t parent, size_t child) {
+    assert(parent < nodes_.size());
+    assert(child  < nodes_.size());
+    edges_.push_back(Edge {parent, child, 0, 0, false});
+  }
+
+  // Connects an output of lambda to an input of another, which is also an
+  // edge.
+  void Connect(size_t out, size_t out_i, size_t in, size_t in_i) {
+    assert(out < nodes_.size() && nodes_[out].lambda);
+    assert(in  < nodes_.size() && nodes_[in].lambda);
+    edges_.push_back(Edge {out, in, out_i, in_i, true});
+  }
+
+
+  // Returns true if the graph has no cycles.
+  bool Validate() const;
+
+  // Wires, triggers and attaches all tasks to the queue, and clears the
+  // builder. The returned future becomes ready when all tasks are done, or
+  // holds CancelledError when any leaf is cancelled.
+  //
+  // A graph with cycles is rejected without attaching any task. The builder
+  // is cleared too, and the future holds std::invalid_argument.
+  std::future<void> Submit(TaskQueue* q);
+
+
+  size_t size() const {
+    return nodes_.size();
+  }
+
+ private:
+  struct Node final {
+   public:
+    std::shared_ptr<iTask> task;
+
+    iLambda* lambda;
+  };
+  struct Edge final {
+   public:
+    size_t parent;
+    size_t child;
+
+    // used only when connect is true
+    size_t out_i;
+    size_t in_i;
+
+    bool connect;
+  };
+
+
+  std::vector<Node> nodes_;
+
+  std::vector<Edge> edges_;
+};
+
+
+void iTask::Release() {
+  assert(deps_);
+  if (--deps_) return;
+
+  auto q = q_.load();
+  if (q && !scheduled_.exchange(true)) q->Push(this);
+}
+
 }  // namespace mnian::core
@@ -0,0 +1,243 @@
+// No copyright
+#include "mncore/tensor.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include "mncore/buffer.h"
+
+
+namespace mnian::core {
+
+static constexpr char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string EncodeBase64(const uint8_t* p, size_t n) {
+  std::string ret;
+  ret.reserve((n+2)/3*4);
+  for (size_t i = 0; i < n; i += 3) {
+    const uint32_t v =
+        (uint32_t{p[i]} << 16) |
+        (i+1 < n? uint32_t{p[i+1]} << 8: 0) |
+        (i+2 < n? uint32_t{p[i+2]}: 0);
+    ret += kBase64[(v >> 18) & 63];
+    ret += kBase64[(v >> 12) & 63];
+    ret += i+1 < n? kBase64[(v >> 6) & 63]: '=';
+    ret += i+2 < n? kBase64[v & 63]: '=';
+  }
+  return ret;
+}
+
+static std::optional<std::vector<uint8_t>> DecodeBase64(std::string_view s) {
+  if (s.size()%4) return std::nullopt;
+
+  std::vector<uint8_t> ret;
+  ret.reserve(s.size()/4*3);
+
+  uint32_t v    = 0;
+  size_t   bits = 0;
+  for (size_t i = 0; i < s.size(); ++i) {
+    const auto c = s[i];
+    if (c == '=') {
+      if (i+2 < s.size()) return std::nullopt;
+      break;
+    }
+    const auto itr = std::find(std::begin(kBase64), std::end(kBase64)-1, c);
+    if (itr == std::end(kBase64)-1) return std::nullopt;
+
+    v     = (v << 6) | static_cast<uint32_t>(itr-std::begin(kBase64));
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      ret.push_back(static_cast<uint8_t>(v >> bits));
+    }
+  }
+  return ret;
+}
+
+
+size_t Tensor::SizeOf(DType dtype) {
+  switch (dtype) {
+  case kU8:  return 1;
+  case kI32: return 4;
+  case kI64: return 8;
+  case kF32: return 4;
+  case kF64: return 8;
+  }
+  assert(false);
+  return 0;
+}
+
+const char* Tensor::StringifyDType(DType dtype) {
+  switch (dtype) {
+  case kU8:  return "u8";
+  case kI32: return "i32";
+  case kI64: return "i64";
+  case kF32: return "f32";
+  case kF64: return "f64";
+  }
+  assert(false);
+  return "";
+}
+
+std::optional<Tensor::DType> Tensor::ParseDType(std::string_view str) {
+  for (auto t : {kU8, kI32, kI64, kF32, kF64}) {
+    if (str == StringifyDType(t)) return t;
+  }
+  return std::nullopt;
+}
+
+
+Tensor::Strides Tensor::MakeStrides(const Shape& shape) {
+  Strides ret(shape.size());
+
+  int64_t n = 1;
+  for (size_t i = shape.size(); i > 0; --i) {
+    ret[i-1] = n;
+    n       *= static_cast<int64_t>(shape[i-1]);
+  }
+  return ret;
+}
+
+std::shared_ptr<const Tensor> Tensor::Create(DType dtype, Shape&& shape) {
+  return Builder(dtype, std::move(shape)).Build();
+}
+
+std::shared_ptr<const Tensor> Tensor::Decode(std::string_view str) {
+  const auto a = str.find(';');
+  if (a == std::string_view::npos) return nullptr;
+  const auto b = str.find(';', a+1);
+  if (b == std::string_view::npos) return nullptr;
+
+  const auto dtype = ParseDType(str.substr(0, a));
+  if (!dtype) return nullptr;
+
+  Shape shape;
+  for (auto s = str.substr(a+1, b-a-1); !s.empty();) {
+    const auto c = s.find(',');
+    const auto v = s.substr(0, c);
+
+    size_t n;
+    const auto [end, ec] = std::from_chars(v.data(), v.data()+v.size(), n);
+    if (ec != std::errc() || end != v.data()+v.size()) return nullptr;
+    shape.push_back(n);
+
+    if (c == std::string_view::npos) break;
+    s = s.substr(c+1);
+  }
+
+  const auto data = DecodeBase64(str.substr(b+1));
+  if (!data) return nullptr;
+
+  // The shape is checked against the data before allocation, since the string
+  // might be broken or malicious.
+  size_t bytes = SizeOf(*dtype);
+  for (auto n : shape) {
+    if (n && bytes > std::numeric_limits<size_t>::max()/n) return nullptr;
+    bytes *= n;
+  }
+  if (data->size() != bytes) return nullptr;
+
+  Builder ret(*dtype, std::move(shape));
+  std::memcpy(ret.ptr(), data->data(), data->size());
+  return ret.Build();
+}
+
+
+std::shared_ptr<const Tensor> Tensor::Slice(size_t begin, size_t end) const {
+  assert(shape_.size());
+  assert(begin <= end && end <= shape_[0]);
+
+  auto shape = shape_;
+  shape[0]   = end-begin;
+
+  auto strides = strides_;
+  return std::make_shared<Tensor>(
+      dtype_, std::move(shape), std::move(strides), storage_,
+      offset_ + begin*static_cast<size_t>(strides_[0]));
+}
+
+std::shared_ptr<const Tensor> Tensor::Transpose() const {
+  Shape   shape(shape_.rbegin(), shape_.rend());
+  Strides strides(strides_.rbegin(), strides_.rend());
+  return std::make_shared<Tensor>(
+      dtype_, std::move(shape), std::move(strides), storage_, offset_);
+}
+
+std::shared_ptr<const Tensor> Tensor::Copy() const {
+  Builder ret(dtype_, Shape(shape_));
+  if (contiguous()) {
+    std::memcpy(ret.ptr(), ptr(), bytes());
+    return ret.Build();
+  }
+
+  const auto n   = SizeOf(dtype_);
+  auto       src = static_cast<const std::byte*>(ptr());
+  auto       dst = static_cast<std::byte*>(ret.ptr());
+  Visit([&](int64_t i) {
+          std::memcpy(dst, src + i*static_cast<int64_t>(n), n);
+          dst += n;
+        });
+  return ret.Build();
+}
+
+std::string Tensor::Encode() const {
+  std::string ret = StringifyDType(dtype_);
+  ret += ';';
+  for (size_t i = 0; i < shape_.size(); ++i) {
+    if (i) ret += ',';
+    ret += std::to_string(shape_[i]);
+  }
+  ret += ';';
+
+  const auto c = contiguous()? nullptr: Copy();
+  const auto p = static_cast<const uint8_t*>(c? c->ptr(): ptr());
+  ret += EncodeBase64(p, bytes());
+  return ret;
+}
+
+void Tensor::Visit(const std::function<void(int64_t)>& fn) const {
+  if (size() == 0) return;
+
+  std::vector<size_t> idx(shape_.size(), 0);
+  int64_t off = 0;
+  for (;;) {
+    fn(off);
+
+    // increments the index like an odometer
+    size_t d = idx.size();
+    for (; d > 0; --d) {
+      off += strides_[d-1];
+      if (++idx[d-1] < shape_[d-1]) break;
+
+      off      -= strides_[d-1]*static_cast<int64_t>(shape_[d-1]);
+      idx[d-1]  = 0;
+    }
+    if (d == 0) return;
+  }
+}
+
+
+Tensor::Builder::Builder(DType dtype, Shape&& shape) :
+    dtype_(dtype), shape_(std::move(shape)) {
+  static_assert(BufferPool::kAlign >= kAlign);
+
+  size_t n = SizeOf(dtype_);
+  for (auto s : shape_) n *= s;
+
+  storage_ = BufferPool::Allocate(n);
+  std::memset(storage_.get(), 0, n);
+}
+
+std::shared_ptr<const Tensor> Tensor::Builder::Build() {
+  assert(storage_);
+
+  auto strides = MakeStrides(shape_);
+  return std::make_shared<const Tensor>(
+      dtype_, Shape(shape_), std::move(strides), std::move(storage_));
+}
+
+}  // namespace mnian::core
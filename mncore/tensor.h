@@ -0,0 +1,234 @@
+// No copyright
+//
+// This file declares a tensor, a typed multi-dimensional array passed between
+// lambdas as SharedAny.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace mnian::core {
+
+// Tensor is an immutable view of storage with shape, strides and dtype. The
+// storage is 64-byte-aligned and shared by views, so slicing or passing it
+// between lambdas doesn't copy data. Data is written only through a Builder,
+// which owns the storage exclusively until it's published.
+class Tensor final {
+ public:
+  class Builder;
+
+  enum DType {
+    kU8,
+    kI32,
+    kI64,
+    kF32,
+    kF64,
+  };
+
+  static constexpr size_t kAlign = 64;
+
+  using Shape   = std::vector<size_t>;
+  using Strides = std::vector<int64_t>;  // in elements
+
+  using Storage = std::shared_ptr<const std::byte>;
+
+
+  static size_t SizeOf(DType dtype);
+
+  static const char* StringifyDType(DType dtype);
+  static std::optional<DType> ParseDType(std::string_view str);
+
+  template <typename T>
+  static constexpr DType DTypeOf() {
+    if constexpr (std::is_same<T, uint8_t>::value) return kU8;
+    else if constexpr (std::is_same<T, int32_t>::value) return kI32;
+    else if constexpr (std::is_same<T, int64_t>::value) return kI64;
+    else if constexpr (std::is_same<T, float>::value) return kF32;
+    else if constexpr (std::is_same<T, double>::value) return kF64;
+    else []<bool f = false>() { static_assert(f, "unknown element type"); }();
+  }
+
+  // Returns row-major strides of the shape.
+  static Strides MakeStrides(const Shape& shape);
+
+  // Creates a zero-filled tensor with contiguous storage.
+  static std::shared_ptr<const Tensor> Create(DType dtype, Shape&& shape);
+
+  // Decodes a string made by Encode(), or returns nullptr if it's broken.
+  static std::shared_ptr<const Tensor> Decode(std::string_view str);
+
+
+  Tensor() = delete;
+  Tensor(DType     dtype,
+         Shape&&   shape,
+         Strides&& strides,
+         Storage   storage,
+         size_t    offset = 0) :
+      dtype_(dtype), shape_(std::move(shape)), strides_(std::move(strides)),
+      storage_(std::move(storage)), offset_(offset) {
+    assert(shape_.size() == strides_.size());
+    assert(storage_);
+  }
+
+  Tensor(const Tensor&) = delete;
+  Tensor(Tensor&&) = delete;
+
+  Tensor& operator=(const Tensor&) = delete;
+  Tensor& operator=(Tensor&&) = delete;
+
+
+  // Returns a view of [begin, end) along the first axis.
+  std::shared_ptr<const Tensor> Slice(size_t begin, size_t end) const;
+
+  // Returns a view whose axes are reversed.
+  std::shared_ptr<const Tensor> Transpose() const;
+
+  // Returns a contiguous copy.
+  std::shared_ptr<const Tensor> Copy() const;
+
+  // Encodes the dtype, shape and data into a string, like
+  // "f32;2,3;<base64 of data>".
+  std::string Encode() const;
+
+  // Calls fn(offset) for each element in row-major order, where offset is in
+  // elements from data().
+  void Visit(const std::function<void(int64_t)>& fn) const;
+
+
+  template <typename T>
+  const T* data() const {
+    assert(DTypeOf<T>() == dtype_);
+    return reinterpret_cast<const T*>(ptr());
+  }
+
+  template <typename T>
+  const T& at(std::initializer_list<size_t> idx) const {
+    return data<T>()[OffsetOf(idx)];
+  }
+
+  const void* ptr() const {
+    return storage_.get() + offset_*SizeOf(dtype_);
+  }
+
+  DType dtype() const {
+    return dtype_;
+  }
+  const Shape& shape() const {
+    return shape_;
+  }
+  const Strides& strides() const {
+    return strides_;
+  }
+  const Storage& storage() const {
+    return storage_;
+  }
+
+  // Returns a number of elements.
+  size_t size() const {
+    size_t ret = 1;
+    for (auto n : shape_) ret *= n;
+    return ret;
+  }
+  size_t bytes() const {
+    return size()*SizeOf(dtype_);
+  }
+  bool contiguous() const {
+    return strides_ == MakeStrides(shape_);
+  }
+
+ private:
+  int64_t OffsetOf(std::initializer_list<size_t> idx) const {
+    assert(idx.size() == shape_.size());
+
+    int64_t ret = 0;
+    size_t  i   = 0;
+    for (auto n : idx) {
+      assert(n < shape_[i]);
+      ret += static_cast<int64_t>(n)*strides_[i++];
+    }
+    return ret;
+  }
+
+
+  DType dtype_;
+
+  Shape   shape_;
+  Strides strides_;
+
+  Storage storage_;
+
+  // in elements
+  size_t offset_;
+};
+
+
+// Builder allocates zero-filled contiguous storage aligned to Tensor::kAlign
+// from BufferPool, and is the only owner able to write it. Build() gives the
+// storage up to an immutable tensor, so no writes happen after publishing.
+class Tensor::Builder final {
+ public:
+  Builder() = delete;
+  Builder(DType dtype, Shape&& shape);
+
+  Builder(const Builder&) = delete;
+  Builder(Builder&&) = default;
+
+  Builder& operator=(const Builder&) = delete;
+  Builder& operator=(Builder&&) = default;
+
+
+  // Publishes the data as a tensor. The builder is empty after this.
+  std::shared_ptr<const Tensor> Build();
+
+
+  template <typename T>
+  T* data() {
+    assert(DTypeOf<T>() == dtype_);
+    return reinterpret_cast<T*>(ptr());
+  }
+
+  template <typename T>
+  T& at(std::initializer_list<size_t> idx) {
+    assert(idx.size() == shape_.size());
+
+    size_t off = 0;
+    size_t i   = 0;
+    for (auto n : idx) {
+      assert(n < shape_[i]);
+      off = off*shape_[i++] + n;
+    }
+    return data<T>()[off];
+  }
+
+  void* ptr() {
+    assert(storage_);
+    return storage_.get();
+  }
+
+  DType dtype() const {
+    return dtype_;
+  }
+  const Shape& shape() const {
+    return shape_;
+  }
+
+ private:
+  DType dtype_;
+
+  Shape shape_;
+
+  std::shared_ptr<std::byte> storage_;
+};
+
+}  // namespace mnian::core
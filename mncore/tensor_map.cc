@@ -0,0 +1,49 @@
+// No copyright
+#include "mncore/tensor_map.h"
+
+#include <cassert>
+#include <utility>
+
+
+namespace mnian::core {
+
+TensorMap::TensorMap(iFile*          file,
+                     Tensor::DType   dtype,
+                     Tensor::Shape&& shape,
+                     size_t          offset) :
+    iFileObserver(file),
+    dtype_(dtype), shape_(std::move(shape)), offset_(offset) {
+  // Tensor takes an offset in elements.
+  assert(offset_%Tensor::SizeOf(dtype_) == 0);
+}
+
+std::shared_ptr<const Tensor> TensorMap::Get() {
+  // The file is locked first as Watch() calls ObserveUpdate() under the lock.
+  auto k = target().Lock();
+
+  std::lock_guard<std::mutex> _(mtx_);
+  if (tensor_) return tensor_;
+
+  size_t n = Tensor::SizeOf(dtype_);
+  for (auto s : shape_) n *= s;
+
+  size_t size = 0;
+  auto   map  = k.Map(&size);
+  if (!map || size < offset_+n) return nullptr;
+
+  tensor_ = std::make_shared<const Tensor>(
+      dtype_,
+      Tensor::Shape(shape_),
+      Tensor::MakeStrides(shape_),
+      std::move(map),
+      offset_/Tensor::SizeOf(dtype_));
+  return tensor_;
+}
+
+void TensorMap::ObserveUpdate() {
+  std::lock_guard<std::mutex> _(mtx_);
+  tensor_ = nullptr;
+  ++version_;
+}
+
+}  // namespace mnian::core
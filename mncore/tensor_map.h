@@ -0,0 +1,81 @@
+// No copyright
+//
+// This file declares a read-only tensor view over a memory-mapped file.
+#pragma once
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+
+#include "mncore/file.h"
+#include "mncore/tensor.h"
+
+
+namespace mnian::core {
+
+// TensorMap provides a tensor whose storage is a read-only mapping of raw file
+// contents, so large inputs are passed to lambdas without copies. The mapping
+// is dropped when the file is updated, and remapped by the next Get().
+//
+// Views taken before the update keep the old mapping alive. It's shared with
+// the file, so their contents might change too. The file can't be truncated
+// through iFile::LockGuard while views are alive, but truncation by other
+// processes makes accessing beyond the new end raise SIGBUS. Unlike allocated
+// tensors, the storage is aligned only to the page plus offset.
+//
+// The file must be alive as long as this observer is.
+class TensorMap final : public iFileObserver {
+ public:
+  TensorMap() = delete;
+  TensorMap(iFile*          file,
+            Tensor::DType   dtype,
+            Tensor::Shape&& shape,
+            size_t          offset = 0);
+
+  TensorMap(const TensorMap&) = delete;
+  TensorMap(TensorMap&&) = delete;
+
+  TensorMap& operator=(const TensorMap&) = delete;
+  TensorMap& operator=(TensorMap&&) = delete;
+
+
+  // Returns the view mapping the file, or nullptr when the file is too small
+  // for the shape or can't be mapped. Don't call it while the file is locked.
+  std::shared_ptr<const Tensor> Get();
+
+  void ObserveUpdate() override;
+
+
+  Tensor::DType dtype() const {
+    return dtype_;
+  }
+  const Tensor::Shape& shape() const {
+    return shape_;
+  }
+  size_t offset() const {
+    return offset_;
+  }
+
+  // Returns a number of updates observed, which tells callers to take a new
+  // view.
+  uint64_t version() const {
+    return version_;
+  }
+
+ private:
+  const Tensor::DType dtype_;
+
+  const Tensor::Shape shape_;
+
+  const size_t offset_;
+
+  std::mutex mtx_;
+
+  std::shared_ptr<const Tensor> tensor_;
+
+  std::atomic<uint64_t> version_ = 0;
+};
+
+}  // namespace mnian::core
@@ -0,0 +1,141 @@
+// No copyright
+//
+// This file declares small vectors passed between lambdas as SharedAny, and
+// batch math over spans of them.
+#pragma once
+
+#include <linalg_aliases.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+
+namespace mnian::core {
+
+template <int M>
+using Vec = linalg::vec<double, M>;
+
+using Vec2 = linalg::double2;
+using Vec3 = linalg::double3;
+using Vec4 = linalg::double4;
+
+// Spans of vectors are treated as flat arrays of doubles.
+static_assert(sizeof(Vec2) == sizeof(double)*2);
+static_assert(sizeof(Vec3) == sizeof(double)*3);
+static_assert(sizeof(Vec4) == sizeof(double)*4);
+
+
+// Stringifies components separated by comma, like "1,2.5,3".
+template <int M>
+std::string StringifyVec(const Vec<M>& v) {
+  std::string ret;
+  for (int i = 0; i < M; ++i) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.17g", v[i]);
+    if (i) ret += ',';
+    ret += buf;
+  }
+  return ret;
+}
+
+// Parses a string made by StringifyVec(), or returns nullopt if it's broken.
+template <int M>
+std::optional<Vec<M>> ParseVec(const std::string& str) {
+  Vec<M> ret;
+
+  const char* p = str.c_str();
+  for (int i = 0; i < M; ++i) {
+    if (i && *p++ != ',') return std::nullopt;
+
+    char* end;
+    ret[i] = std::strtod(p, &end);
+    if (end == p || !std::isfinite(ret[i])) return std::nullopt;
+    p = end;
+  }
+  if (*p) return std::nullopt;
+  return ret;
+}
+
+
+// Batch operations below are written as plain loops over contiguous
+// components, which compilers can vectorize. Output spans may alias inputs.
+
+// y[i] += a*x[i]
+template <int M>
+void Axpy(double a, std::span<const Vec<M>> x, std::span<Vec<M>> y) {
+  assert(x.size() == y.size());
+  for (size_t i = 0; i < x.size(); ++i) {
+    for (int k = 0; k < M; ++k) y[i][k] += a*x[i][k];
+  }
+}
+
+// out[i] = a[i] + (b[i]-a[i])*t
+template <int M>
+void Lerp(std::span<const Vec<M>> a,
+          std::span<const Vec<M>> b,
+          double                  t,
+          std::span<Vec<M>>       out) {
+  assert(a.size() == b.size());
+  assert(a.size() == out.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    for (int k = 0; k < M; ++k) out[i][k] = a[i][k] + (b[i][k]-a[i][k])*t;
+  }
+}
+
+// out[i] = dot(a[i], b[i])
+template <int M>
+void Dot(std::span<const Vec<M>> a,
+         std::span<const Vec<M>> b,
+         std::span<double>       out) {
+  assert(a.size() == b.size());
+  assert(a.size() == out.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    double sum = 0;
+    for (int k = 0; k < M; ++k) sum += a[i][k]*b[i][k];
+    out[i] = sum;
+  }
+}
+
+// out[i] = length(v[i])
+template <int M>
+void Length(std::span<const Vec<M>> v, std::span<double> out) {
+  Dot<M>(v, v, out);
+  for (auto& x : out) x = std::sqrt(x);
+}
+
+// Normalizes each vector in place. Zero vectors are left as they are.
+template <int M>
+void Normalize(std::span<Vec<M>> v) {
+  for (auto& x : v) {
+    double sum = 0;
+    for (int k = 0; k < M; ++k) sum += x[k]*x[k];
+    if (sum == 0) continue;
+
+    const double inv = 1/std::sqrt(sum);
+    for (int k = 0; k < M; ++k) x[k] *= inv;
+  }
+}
+
+// Returns componentwise minimum and maximum. The span must not be empty.
+template <int M>
+std::pair<Vec<M>, Vec<M>> Bounds(std::span<const Vec<M>> v) {
+  assert(v.size());
+
+  auto ret = std::make_pair(v[0], v[0]);
+  for (const auto& x : v) {
+    for (int k = 0; k < M; ++k) {
+      ret.first[k]  = std::min(ret.first[k], x[k]);
+      ret.second[k] = std::max(ret.second[k], x[k]);
+    }
+  }
+  return ret;
+}
+
+}  // namespace mnian::core
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 
+#include <algorithm>
 #include <filesystem>  // NOLINT(build/c++11)
 #include <fstream>
 #include <memory>
@@ -13,6 +14,7 @@
 
 #include <Tracy.hpp>
 
+#include "mncore/buffer.h"
 #include "mncore/serialize.h"
 
 #include "mnres/all.h"
@@ -23,11 +25,25 @@
 
 namespace mnian {
 
-static constexpr size_t kCpuWorkerCount = 4;
-
 static constexpr const char* kFileName = "mnian.json";
 
 
+// Update() is expected to finish within this duration, and the rest of frame
+// is left for rendering.
+static constexpr auto kUpdateTarget = std::chrono::microseconds(8000);
+
+// The minimum budget to drain mainQ, which ensures the queue progresses even
+// when the UI is heavy.
+static constexpr auto kMainBudgetMin = std::chrono::microseconds(1000);
+
+// The main loop keeps rendering this number of frames after any event, since
+// ImGui takes a few frames to settle its state.
+static constexpr size_t kActiveFrames = 3;
+
+// The main loop sleeps until any event comes, with this timeout while idle.
+static constexpr double kIdleTimeout = .5;  // = 500 ms
+
+
 static constexpr const char* kPanicPopupId = "PANIC##mnian/app";
 
 static constexpr auto kPanicPopupFlags =
@@ -37,11 +53,20 @@ static constexpr auto kPanicPopupFlags =
 App* App::instance_ = nullptr;
 
 
-App::App(GLFWwindow* window, const core::DeserializerRegistry* reg) :
+App::App(GLFWwindow*                      window,
+         const core::DeserializerRegistry* reg,
+         const CpuWorker::Config&          cpu) :
     iApp(&clock_, reg, &logger_, &fstore_, std::make_unique<OriginCommand>()),
-    window_(window), cpu_worker_(&cpuQ(), kCpuWorkerCount) {
+    window_(window),
+    cpu_worker_(&cpuQ(), cpu),
+    gl_worker_(&gl3Q(), window),
+    main_budget_(kUpdateTarget) {
   instance_ = this;
 
+  // wakes up the main loop sleeping when tasks are posted
+  mainQ().notifier([]() { glfwPostEmptyEvent(); });
+  frame_begin_ = std::chrono::steady_clock::now();
+
   // load default language
   {
     std::stringstream st;
@@ -103,10 +128,34 @@ void App::Quit() {
 }
 
 
+void App::WaitEvents() {
+  const auto now = std::chrono::steady_clock::now();
+
+  auto& st = frame_stats_;
+  st.last = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - frame_begin_);
+  st.average = st.frames? (st.average*7 + st.last)/8: st.last;
+  ++st.frames;
+  TracyPlot("frame time (us)", static_cast<int64_t>(st.last.count()));
+
+  if (HasTasks()) active_frames_ = kActiveFrames;
+  if (active_frames_) {
+    --active_frames_;
+    glfwPollEvents();
+  } else {
+    ++st.idles;
+    glfwWaitEventsTimeout(kIdleTimeout);
+    active_frames_ = kActiveFrames;
+  }
+  frame_begin_ = std::chrono::steady_clock::now();
+}
+
 void App::Update() {
   ZoneScoped;
   clock_.Tick();
 
+  const auto begin = std::chrono::steady_clock::now();
+
   // app menu
   if (ImGui::BeginMainMenuBar()) {
     if (ImGui::BeginMenu(_("App"))) {
@@ -149,8 +198,44 @@ void App::Update() {
     return;
   }
 
-  // dequeue taskq
-  while (mainQ().Dequeue()) continue;
+  // dequeue taskq within the budget, which is shared by mainQ and gl3Q
+  {
+    const auto until = std::chrono::steady_clock::now() + main_budget_;
+    {
+      ZoneScopedN("drain mainQ");
+      mainQ().Drain(main_budget_);
+    }
+    if (!gl_worker_.running()) {
+      ZoneScopedN("drain gl3Q");
+      gl3Q().Drain(until - std::chrono::steady_clock::now());
+    }
+  }
+
+  TracyPlot("mainQ leftover", static_cast<int64_t>(mainQ().readyCount()));
+
+  // plots metrics of other queues
+  {
+    const auto  cpu  = cpuQ().sample();
+    const auto& prev = cpu_sample_;
+    TracyPlot("cpuQ depth",  static_cast<int64_t>(cpu.depth));
+    TracyPlot("cpuQ steals", static_cast<int64_t>(cpu.steals-prev.steals));
+    TracyPlot("cpuQ idle",   core::TaskMetrics::Sample::IdleRatio(prev, cpu));
+    cpu_sample_ = cpu;
+
+    TracyPlot("gl3Q depth", static_cast<int64_t>(gl3Q().readyCount()));
+
+    const auto ms = memo().stats();
+    const auto saved =
+        std::chrono::duration_cast<std::chrono::milliseconds>(ms.saved);
+    TracyPlot("memo hit ratio",  ms.hitRatio());
+    TracyPlot("memo saved (ms)", static_cast<int64_t>(saved.count()));
+    TracyPlot("memo size (KB)",  static_cast<int64_t>(ms.bytes/1024));
+
+    const auto bs = core::BufferPool::stats();
+    TracyPlot("buffer hit ratio",   bs.hitRatio());
+    TracyPlot("buffer live (KB)",   static_cast<int64_t>(bs.live/1024));
+    TracyPlot("buffer cached (KB)", static_cast<int64_t>(bs.cached/1024));
+  }
 
   // update editor
   project().wstore().Update();
@@ -159,6 +244,24 @@ void App::Update() {
 # if !defined(NDEBUG)
     ImGui::ShowDemoWindow();
 # endif
+
+  // adapts the budget to the measured duration of this update, smoothly
+  {
+    const auto took = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin);
+
+    const auto target = std::clamp(
+        main_budget_ + (kUpdateTarget - took), kMainBudgetMin, kUpdateTarget);
+    main_budget_ = (main_budget_*3 + target)/4;
+
+    TracyPlot("update time (us)",  static_cast<int64_t>(took.count()));
+    TracyPlot("mainQ budget (us)", static_cast<int64_t>(main_budget_.count()));
+  }
+}
+
+
+bool App::HasTasks() {
+  return mainQ().size() || cpuQ().size() || gl3Q().size();
 }
 
 
@@ -6,6 +6,7 @@
 #include <imgui.h>
 
 #include <cassert>
+#include <chrono>  // NOLINT(build/c++11)
 #include <string>
 
 #include "mncore/app.h"
@@ -22,13 +23,30 @@ namespace mnian {
 
 class App : public core::iApp {
  public:
+  struct FrameStats final {
+   public:
+    // duration of the last frame, excluding time waiting for events
+    std::chrono::microseconds last = {};
+
+    // exponential moving average of frame durations
+    std::chrono::microseconds average = {};
+
+    size_t frames = 0;
+
+    // times the main loop slept until any event comes
+    size_t idles = 0;
+  };
+
+
   static App& instance() {
     return *instance_;
   }
 
 
   App() = delete;
-  App(GLFWwindow* window, const core::DeserializerRegistry* reg);
+  App(GLFWwindow*                      window,
+      const core::DeserializerRegistry* reg,
+      const CpuWorker::Config&          cpu);
 
   App(const App&) = delete;
   App(App&&) = delete;
@@ -42,6 +60,11 @@ class App : public core::iApp {
   void Panic(const std::string& msg) override;
   void Quit() override;
 
+  // Polls events while the app is active, otherwise sleeps until any event
+  // comes or tasks are posted to mainQ. This should be called at the beginning
+  // of each frame.
+  void WaitEvents();
+
   void Update();
 
 
@@ -56,6 +79,10 @@ class App : public core::iApp {
     return lang_;
   }
 
+  const FrameStats& frameStats() const {
+    return frame_stats_;
+  }
+
  private:
   static App* instance_;
 
@@ -65,6 +92,9 @@ class App : public core::iApp {
 
   void LoadInitialProject();
 
+  // Returns true if any task is in flight.
+  bool HasTasks();
+
 
   bool alive_ = true;
 
@@ -82,6 +112,22 @@ class App : public core::iApp {
   FileStore fstore_;
 
   CpuWorker cpu_worker_;
+
+  GlWorker gl_worker_;
+
+  // mainQ and gl3Q are drained within this budget in each frame, which is
+  // adapted to the measured duration of Update().
+  std::chrono::microseconds main_budget_;
+
+  // The main loop doesn't sleep until this reaches zero.
+  size_t active_frames_ = 0;
+
+  std::chrono::steady_clock::time_point frame_begin_;
+
+  FrameStats frame_stats_;
+
+  // the last sample of cpuQ metrics, to plot differences
+  core::TaskMetrics::Sample cpu_sample_;
 };
 
 
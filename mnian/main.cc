@@ -7,7 +7,7 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
-#include <thread>  // NOLINT(build/c++11)
+#include <cstdlib>
 
 #include <Tracy.hpp>
 
@@ -34,7 +34,30 @@ static void GlfwErrorCallback(int, const char* description) {
   TracyMessageLCS(description, tracy::Color::Gray, 0);
 }
 
-int main(int, char**) {
+// Parses command line options:
+//   --cpu-workers=N  a number of CPU workers (default: cores - 1)
+//   --pin-workers    pins each CPU worker to a core
+//   --numa           groups CPU workers per NUMA node
+static mnian::CpuWorker::Config ParseCpuWorkerConfig(int argc, char** argv) {
+  static constexpr const char* kCount = "--cpu-workers=";
+
+  mnian::CpuWorker::Config ret;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (strncmp(arg, kCount, strlen(kCount)) == 0) {
+      ret.count = std::strtoul(arg+strlen(kCount), nullptr, 10);
+    } else if (strcmp(arg, "--pin-workers") == 0) {
+      ret.pin = true;
+    } else if (strcmp(arg, "--numa") == 0) {
+      ret.numa = true;
+    }
+  }
+  return ret;
+}
+
+int main(int argc, char** argv) {
+  const auto cpu = ParseCpuWorkerConfig(argc, argv);
+
   {
     ZoneScopedN("init GLFW");
     glfwSetErrorCallback(GlfwErrorCallback);
@@ -116,46 +139,48 @@ int main(int, char**) {
     ImGui_ImplOpenGL3_Init(glsl_version);
   }
 
-  mnian::core::DeserializerRegistry reg;
-  mnian::SetupDeserializerRegistry(&reg);
-
-  mnian::App app(window, &reg);
-  glfwShowWindow(window);
-
-  tracy::SetThreadName("main");
-  while (app.alive()) {
-    FrameMarkStart("main");
-    {
-      ZoneScopedN("poll events");
-      glfwPollEvents();
-    }
-    {
-      ZoneScopedN("update");
+  // App and its workers must be destroyed before ImGui and GLFW are torn
+  // down, since they may still issue GL and GLFW calls.
+  {
+    mnian::core::DeserializerRegistry reg;
+    mnian::SetupDeserializerRegistry(&reg);
+
+    mnian::App app(window, &reg, cpu);
+    glfwShowWindow(window);
+
+    tracy::SetThreadName("main");
+    while (app.alive()) {
+      FrameMarkStart("main");
+      {
+        ZoneScopedN("wait events");
+        app.WaitEvents();
+      }
+      {
+        ZoneScopedN("update");
 
-      ImGui_ImplOpenGL3_NewFrame();
-      ImGui_ImplGlfw_NewFrame();
-      ImGui::NewFrame();
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
 
-      app.Update();
-    }
-    {
-      ZoneScopedN("render display");
-      ImGui::Render();
+        app.Update();
+      }
+      {
+        ZoneScopedN("render display");
+        ImGui::Render();
 
-      int w, h;
-      glfwGetFramebufferSize(window, &w, &h);
-      glViewport(0, 0, w, h);
+        int w, h;
+        glfwGetFramebufferSize(window, &w, &h);
+        glViewport(0, 0, w, h);
 
-      glClear(GL_COLOR_BUFFER_BIT);
-      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    }
-    {
-      ZoneScopedN("swap buffer");
-      glfwSwapBuffers(window);
+        glClear(GL_COLOR_BUFFER_BIT);
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      }
+      {
+        ZoneScopedN("swap buffer");
+        glfwSwapBuffers(window);
+      }
+      FrameMarkEnd("main");
     }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(30));
-    FrameMarkEnd("main");
   }
 
   {
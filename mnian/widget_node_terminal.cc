@@ -6,13 +6,18 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <chrono>  // NOLINT(build/c++11)
 #include <string>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <Tracy.hpp>
 
+#include "mncore/memo.h"
+#include "mncore/pool.h"
+
 #include "mnian/app.h"
 #include "mnian/widget_node_terminal_command.h"
 
@@ -39,7 +44,7 @@ NodeTerminalWidget::NodeTerminalWidget(core::iApp*                    app,
   const size_t input_size = std::min(input.size(), node_->inputCount());
   for (size_t i = 0; i < input_size; ++i) {
     const auto& sock = node_->input(i);
-    input_[&sock] = input[i];
+    input_[&sock] = sock.Restore(std::move(input[i]));
   }
   unstable_input_ = input_;
 }
@@ -69,7 +74,6 @@ void NodeTerminalWidget::Update() {
         auto&       value = unstable_input_[&sock];
         if (UpdateValue(sock, &value, false)) {
           dirty_ = true;
-          // TODO(falsycat): fuzzy processing
         }
         if (ImGui::IsItemDeactivatedAfterEdit()) {
           std::vector<InputSetCommand::Pair> pairs = {{&sock, value}};
@@ -85,26 +89,37 @@ void NodeTerminalWidget::Update() {
       }
     }
     if (ImGui::CollapsingHeader(_("execution"), flags)) {
-      if (proc_.busy()) {
-        ImGui::ProgressBar(static_cast<float>(proc_.progress()));
-        ImGui::Text(proc_.msg().c_str());
+      const auto& proc = exec_.proc();
+      if (proc.busy()) {
+        ImGui::ProgressBar(static_cast<float>(proc.progress()));
+        ImGui::Text(proc.msg().c_str());
       }
+      const auto& st = exec_.stats();
+      ImGui::Text("%s: %" PRIu64, _("dropped runs"), st.dropped+st.aborted);
     }
   }
   ImGui::End();
 
-  // handle changes
-  if (options_.autoexec && dirty_) ExecNode();
+  // handle changes, whose executions are coalesced so only the latest inputs
+  // are executed
+  if (options_.autoexec && dirty_) {
+    exec_.Request();
+    dirty_       = false;
+    progressive_ = options_.preview;
+  }
+  if (exec_.Poll()) ExecNode(progressive_);
 }
 
 void NodeTerminalWidget::UpdateMenu() {
   if (ImGui::BeginMenuBar()) {
     if (ImGui::BeginMenu(_("actions"))) {
       if (ImGui::MenuItem(_("execute"))) {
-        ExecNode();
+        exec_.Request();
+        progressive_ = false;
       }
-      if (ImGui::MenuItem(_("abort execution"), NULL, false, proc_.busy())) {
-        proc_.RequestAbort();
+      const bool busy = exec_.proc().busy();
+      if (ImGui::MenuItem(_("abort execution"), NULL, false, busy)) {
+        exec_.Abort();
       }
       ImGui::Separator();
       if (ImGui::MenuItem(_("clear input"))) {
@@ -123,12 +138,32 @@ void NodeTerminalWidget::UpdateMenu() {
     if (ImGui::BeginMenu(_("options"))) {
       ImGui::MenuItem(
           _("enable auto execution on change"), NULL, &options_.autoexec);
+      ImGui::MenuItem(
+          _("enable preview on auto execution"), NULL, &options_.preview);
       ImGui::EndMenu();
     }
     ImGui::EndMenuBar();
   }
 }
 
+template <int M>
+bool NodeTerminalWidget::UpdateVec(
+    const core::iNode::Socket& s, core::SharedAny* v, bool constant) {
+  auto& vec = std::get<core::Vec<M>>(*v);
+
+  if (constant) ImGui::BeginDisabled();
+  const bool ret = ImGui::DragScalarN(
+      s.meta().name.c_str(),
+      ImGuiDataType_Double,
+      &vec.x,
+      M,
+      .2f,
+      nullptr,
+      nullptr);
+  if (constant) ImGui::EndDisabled();
+  return ret;
+}
+
 bool NodeTerminalWidget::UpdateValue(
     const core::iNode::Socket& s, core::SharedAny* v, bool constant) {
   bool ret = false;
@@ -155,6 +190,15 @@ bool NodeTerminalWidget::UpdateValue(
         nullptr);
     if (constant) ImGui::EndDisabled();
     break;
+  case core::iNode::Socket::kVec2:
+    ret = UpdateVec<2>(s, v, constant);
+    break;
+  case core::iNode::Socket::kVec3:
+    ret = UpdateVec<3>(s, v, constant);
+    break;
+  case core::iNode::Socket::kVec4:
+    ret = UpdateVec<4>(s, v, constant);
+    break;
   case core::iNode::Socket::kString: {
     const auto flags =
         ImGuiInputTextFlags_NoUndoRedo |
@@ -165,6 +209,20 @@ bool NodeTerminalWidget::UpdateValue(
         ImVec2(0, ImGui::GetFontSize()*3),
         flags);
   } break;
+  case core::iNode::Socket::kTensor: {
+    // Tensor is not editable here, and only its summary is shown.
+    const auto& t = std::get<std::shared_ptr<const core::Tensor>>(*v);
+    std::string shape;
+    if (t) {
+      for (auto n : t->shape()) {
+        shape += (shape.empty()? "": "x") + std::to_string(n);
+      }
+    }
+    ImGui::Text("%s: %s [%s]",
+                s.meta().name.c_str(),
+                t? core::Tensor::StringifyDType(t->dtype()): "null",
+                shape.c_str());
+  } break;
   default:
     assert(false);
     return false;
@@ -173,17 +231,29 @@ bool NodeTerminalWidget::UpdateValue(
 }
 
 
-void NodeTerminalWidget::ExecNode() {
-  if (busy_) {
-    dirty_ = true;
-    if (proc_.busy()) proc_.RequestAbort();
+void NodeTerminalWidget::ExecNode(bool progressive) {
+  // Skips the execution if the same inputs have been processed.
+  std::vector<core::SharedAny> inputs;
+  inputs.reserve(node_->inputCount());
+  for (size_t i = 0; i < node_->inputCount(); ++i) {
+    inputs.push_back(unstable_input_[&node_->input(i)]);
+  }
+  const auto key = core::MemoCache::MakeKey(*node_, inputs);
+  if (auto hit = app_->memo().Find(key)) {
+    for (size_t i = 0; i < node_->outputCount(); ++i) {
+      const auto& sock = node_->output(i);
+      if (sock.index() < hit->size() && (*hit)[sock.index()]) {
+        output_[&sock] = *(*hit)[sock.index()];
+      }
+    }
     return;
   }
 
   class Taker : public core::iLambda {
    public:
-    explicit Taker(NodeTerminalWidget* w) :
-        iLambda(w->output_.size(), 0), w_(w) {
+    Taker(NodeTerminalWidget* w, core::MemoCache::Key key, bool last) :
+        iLambda(w->output_.size(), 0), w_(w), key_(std::move(key)), last_(last),
+        begin_(core::MemoCache::Clock::now()) {
       for (size_t i = 0; i < w_->node_->outputCount(); ++i) {
         const auto& sock = w_->node_->output(i);
         socks_.emplace_back(sock.index(), &sock);
@@ -192,37 +262,72 @@ void NodeTerminalWidget::ExecNode() {
 
    protected:
     void DoExec() override {
+      core::MemoCache::Outputs out(socks_.size());
       for (const auto& p : socks_) {
         w_->output_[p.second] = in(p.first);
+        out[p.first] = inRef(p.first);
+      }
+      if (!last_) return;  // a preview is not memoized
+      w_->exec_.Done();
+
+      // The elapsed time includes waiting in queues, but approximates the cost.
+      if (w_->exec_.proc().state() == core::iNode::Process::kFinished) {
+        w_->app_->memo().Store(
+            key_, std::move(out), core::MemoCache::Clock::now() - begin_);
       }
-      w_->busy_ = false;
+    }
+    void DoCancel() override {
+      if (last_) w_->exec_.Done();
     }
 
    private:
     NodeTerminalWidget* w_;
 
+    core::MemoCache::Key key_;
+
+    bool last_;
+
+    core::MemoCache::Clock::time_point begin_;
+
     std::vector<std::pair<size_t, const core::iNode::Socket*>> socks_;
   };
 
-  proc_ = node_->EnqueueLambda();
+  auto proc = progressive?
+      node_->EnqueueProgressive():
+      node_->EnqueueLambda(core::iNode::kFull);
 
-  auto lambda = proc_.lambda();
-  for (size_t i = 0; i < node_->inputCount(); ++i) {
-    const auto& sock = node_->input(i);
-    lambda->in(sock.index(), core::SharedAny(unstable_input_[&sock]));
+  // All stages share the input values.
+  std::vector<core::iLambda::Value> values;
+  values.reserve(inputs.size());
+  for (auto& v : inputs) {
+    values.push_back(core::iLambda::MakeValue(std::move(v)));
   }
 
-  auto taker = std::make_shared<Taker>(this);
-  for (size_t i = 0; i < node_->outputCount(); ++i) {
-    lambda->Connect(node_->output(i).index(), taker, i);
-  }
-  app_->mainQ().Attach(taker);
+  std::vector<std::shared_ptr<core::iTask>> tasks;
+  for (const core::iNode::ProcessRef* p = &proc; p; p = p->refinement()) {
+    const bool last = !p->refinement();
+
+    auto lambda = p->lambda();
+    for (size_t i = 0; i < node_->inputCount(); ++i) {
+      lambda->in(node_->input(i).index(), values[i]);
+    }
+
+    // The result is waited by user, so the lambda producing it is also
+    // boosted through the connection, except the refinement in background.
+    auto taker = core::MakePooled<Taker>(this, key, last);
+    taker->priority(last && progressive?
+                    core::iTask::kBackground: core::iTask::kInteractive);
+    for (size_t i = 0; i < node_->outputCount(); ++i) {
+      lambda->Connect(node_->output(i).index(), taker, i);
+    }
+    app_->mainQ().Attach(taker);
 
-  busy_  = true;
-  dirty_ = false;
+    tasks.push_back(std::move(lambda));
+    tasks.push_back(std::move(taker));
+  }
+  exec_.Start(std::move(proc));
 
-  lambda->Trigger();
-  taker->Trigger();
+  for (auto& task : tasks) task->Trigger();
 }
 
 void NodeTerminalWidget::CloneWidget() {
@@ -282,9 +387,10 @@ void NodeTerminalWidget::SyncIO() {
 
 
 const char* NodeTerminalWidget::GetStateText() const {
-  if (proc_.empty()) return _("idle");
+  const auto& proc = exec_.proc();
+  if (proc.empty()) return _("idle");
 
-  switch (proc_.state()) {
+  switch (proc.state()) {
   case core::iNode::Process::kPending:
     return _("pending");
   case core::iNode::Process::kRunning:
@@ -338,9 +444,9 @@ void NodeTerminalWidget::SerializeParam(core::iSerializer* serial) const {
 
           auto vitr = input_.find(&sock);
           if (vitr != input_.end()) {
-            serial->SerializeValue(core::FromSharedAny(vitr->second));
+            serial->SerializeSharedAny(vitr->second);
           } else {
-            serial->SerializeValue(core::FromSharedAny(sock.def()));
+            serial->SerializeSharedAny(sock.def());
           }
         }
       });
@@ -3,7 +3,6 @@
 
 #include "mnian/widget.h"
 
-#include <atomic>
 #include <memory>
 #include <unordered_map>
 #include <utility>
@@ -11,6 +10,7 @@
 
 #include "mncore/app.h"
 #include "mncore/conv.h"
+#include "mncore/exec.h"
 #include "mncore/node.h"
 #include "mncore/serialize.h"
 #include "mncore/task.h"
@@ -61,6 +61,9 @@ class NodeTerminalWidget : public ImGuiWidget {
   struct Options {
    public:
     bool autoexec = true;
+
+    // runs a cheap preview first on auto execution
+    bool preview = true;
   };
 
   class InputSetCommand;
@@ -70,8 +73,13 @@ class NodeTerminalWidget : public ImGuiWidget {
   void UpdateMenu();
   bool UpdateValue(
       const core::iNode::Socket& s, core::SharedAny* v, bool constant);
+  template <int M>
+  bool UpdateVec(
+      const core::iNode::Socket& s, core::SharedAny* v, bool constant);
 
-  void ExecNode();
+  // When progressive, a preview comes first and the full quality result
+  // follows.
+  void ExecNode(bool progressive);
   void CloneWidget();
 
   void SyncIO();
@@ -81,11 +89,11 @@ class NodeTerminalWidget : public ImGuiWidget {
 
   core::iApp* app_;
 
-  bool dirty_ = false;  // input changed but node not executed yet
+  bool dirty_ = false;  // input changed but execution not requested yet
 
-  std::atomic<bool> busy_;
+  bool progressive_ = false;  // the pending request wants a preview first
 
-  core::iNode::ProcessRef proc_;
+  core::ExecController exec_;
 
   ValueMap unstable_input_;
 
@@ -62,7 +62,7 @@ class NodeTerminalWidget::InputSetCommand : public core::iCommand {
         des->Leave();
         if (!value) continue;
 
-        pairs.emplace_back(&sock, *value);
+        pairs.emplace_back(&sock, sock.Restore(core::SharedAny(*value)));
       }
     }
 
@@ -138,7 +138,9 @@ class NodeTerminalWidget::InputSetCommand : public core::iCommand {
           for (auto& p : pairs_) {
             core::iSerializer::MapGuard obj(serial);
             obj.Add("index", static_cast<int64_t>(indices[p.first]));
-            obj.Add("value", core::FromSharedAny(p.second));
+            obj.Add(
+                "value",
+                [serial, &v = p.second]() { serial->SerializeSharedAny(v); });
           }
         });
 
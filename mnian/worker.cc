@@ -3,18 +3,116 @@
 
 #include <string.h>
 
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#if defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+#elif defined(_WIN32)
+# include <windows.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+
 #include <Tracy.hpp>
 
+#include "mncore/pool.h"
+
 
 namespace mnian {
 
-static constexpr size_t kSleepTimeout = 50;
+// GL worker waits for the oldest fence with this timeout instead of parking,
+// while any fence is pending.
+static constexpr uint64_t kFenceTimeout = 1000*1000;  // = 1 ms
 
-CpuWorker::CpuWorker(core::TaskQueue* q, size_t n) : q_(q), threads_(n) {
-  size_t i = 0;
-  for (auto& th : threads_) {
-    th = std::thread([this, i]() { Main(i); });
-    ++i;
+
+// Returns CPUs of each NUMA node. When the topology is unknown or `numa` is
+// false, all CPUs are treated as a single node.
+static std::vector<std::vector<size_t>> GetTopology(bool numa) {
+  std::vector<std::vector<size_t>> ret;
+
+# if defined(__linux__)
+    for (size_t i = 0; numa && i < core::Pool::kMaxArenas; ++i) {
+      std::ifstream f(
+          "/sys/devices/system/node/node"+std::to_string(i)+"/cpulist");
+      if (!f) break;
+
+      // The list is formatted like "0-3,8-11".
+      std::vector<size_t> cpus;
+      std::string range;
+      while (std::getline(f, range, ',')) {
+        std::istringstream st(range);
+
+        size_t begin, end;
+        if (!(st >> begin)) break;
+        end = begin;
+        if (st.get() == '-') st >> end;
+        for (auto c = begin; c <= end; ++c) cpus.push_back(c);
+      }
+      if (cpus.empty()) break;
+      ret.push_back(std::move(cpus));
+    }
+# endif
+
+  if (ret.empty()) {
+    std::vector<size_t> cpus(std::max(std::thread::hardware_concurrency(), 1U));
+    for (size_t i = 0; i < cpus.size(); ++i) cpus[i] = i;
+    ret.push_back(std::move(cpus));
+  }
+  return ret;
+}
+
+static void SetAffinity(const std::vector<size_t>& cpus) {
+  if (cpus.empty()) return;
+
+# if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto c : cpus) CPU_SET(c, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+# elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (auto c : cpus) {
+      if (c < sizeof(mask)*8) mask |= DWORD_PTR{1} << c;
+    }
+    if (mask) SetThreadAffinityMask(GetCurrentThread(), mask);
+# endif
+}
+
+
+size_t CpuWorker::DefaultCount() {
+  const size_t n = std::thread::hardware_concurrency();
+  return n > 1? n-1: 1;
+}
+
+
+CpuWorker::CpuWorker(core::TaskQueue* q, const Config& config) :
+    q_(q), threads_(config.count? config.count: DefaultCount()) {
+  const auto nodes = GetTopology(config.numa);
+
+  // Workers fill CPUs in order of node, so neighbors share the node.
+  std::vector<Placement> places;
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    for (auto c : nodes[n]) {
+      Placement p;
+      p.node = n;
+      if (config.pin) {
+        p.cpus = {c};
+      } else if (config.numa) {
+        p.cpus = nodes[n];
+      }
+      places.push_back(std::move(p));
+    }
+  }
+
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i] = std::thread(
+        [this, i, place = places[i%places.size()]]() { Main(i, place); });
   }
 }
 CpuWorker::~CpuWorker() {
@@ -25,7 +123,7 @@ CpuWorker::~CpuWorker() {
   }
 }
 
-void CpuWorker::Main(size_t index) {
+void CpuWorker::Main(size_t index, const Placement& place) {
 # ifdef TRACY_ENABLE
     // this can cause a tiny memory leak that can be ignored
     auto name = new char[32];
@@ -33,13 +131,103 @@ void CpuWorker::Main(size_t index) {
 # endif
 
   tracy::SetThreadName(name);
+
+  // The affinity must be set before the first allocation, to place slabs on
+  // the node.
+  SetAffinity(place.cpus);
+  core::Pool::arena(place.node);
+
+  core::TaskQueue::Worker w(q_);
   while (alive_ || q_->size()) {
     FrameMarkStart(name);
-    if (!q_->Dequeue()) {
-      q_->Sleep(std::chrono::milliseconds(kSleepTimeout));
-    }
+    if (!w.Dequeue()) w.Park();
     FrameMarkEnd(name);
   }
 }
 
+
+thread_local GlWorker* GlWorker::current_ = nullptr;
+
+GlWorker::GlWorker(core::TaskQueue* q, GLFWwindow* share) : q_(q) {
+  assert(q_);
+
+  // The context inherits other hints from the main window, and all hints are
+  // reset not to leak the invisibility to windows created later.
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  ctx_ = glfwCreateWindow(1, 1, "mnian GL worker", nullptr, share);
+  glfwDefaultWindowHints();
+  if (!ctx_) {
+    TracyMessageLCS(
+        "failed to create GL context for worker", tracy::Color::Red, true);
+    return;
+  }
+  thread_ = std::thread([this]() { Main(); });
+}
+GlWorker::~GlWorker() {
+  alive_ = false;
+  q_->WakeUp();
+  if (thread_.joinable()) thread_.join();
+  if (ctx_) glfwDestroyWindow(ctx_);
+}
+
+void GlWorker::Main() {
+  tracy::SetThreadName("GL worker");
+
+  glfwMakeContextCurrent(ctx_);
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK) {
+    TracyMessageLCS("failed to init GLEW", tracy::Color::Red, true);
+  }
+
+  current_ = this;
+  {
+    core::TaskQueue::Worker w(q_);
+    while (alive_ || q_->size() || fences_.size()) {
+      auto found = w.Dequeue();
+
+      // GPU passes fences in order of issue.
+      while (fences_.size()) {
+        const auto timeout = found? 0: kFenceTimeout;
+        if (!fences_.front()->Wait(timeout)) break;
+        fences_.erase(fences_.begin());
+        found = true;
+      }
+      if (!found && fences_.empty()) w.Park();
+    }
+  }
+  current_ = nullptr;
+
+  glfwMakeContextCurrent(nullptr);
+}
+
+
+void GlWorker::Fence::DoExec() {
+  auto w = GlWorker::current_;
+  if (!w) {
+    // Executed by other thread, so waits for GPU synchronously.
+    glFinish();
+    return;
+  }
+
+  sync_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+
+  Defer();
+  w->fences_.push_back(std::static_pointer_cast<Fence>(shared_from_this()));
+}
+
+bool GlWorker::Fence::Wait(uint64_t timeout_ns) {
+  assert(sync_);
+
+  const auto sync = static_cast<GLsync>(sync_);
+  if (glClientWaitSync(sync, 0, timeout_ns) == GL_TIMEOUT_EXPIRED) {
+    return false;
+  }
+  glDeleteSync(sync);
+  sync_ = nullptr;
+
+  Finish();
+  return true;
+}
+
 }  // namespace mnian
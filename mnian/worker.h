@@ -2,18 +2,40 @@
 #pragma once
 
 #include <atomic>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <memory>
 #include <thread>  // NOLINT(build/c++11)
 #include <vector>
 
 #include "mncore/task.h"
 
 
+struct GLFWwindow;
+
+
 namespace mnian {
 
 class CpuWorker {
  public:
+  struct Config final {
+   public:
+    // a number of worker threads, 0 means DefaultCount()
+    size_t count = 0;
+
+    // pins each worker to a core
+    bool pin = false;
+
+    // groups workers per NUMA node, and keeps their allocations node-local
+    bool numa = false;
+  };
+
+
+  // Returns a number of hardware threads except one for the main thread.
+  static size_t DefaultCount();
+
+
   CpuWorker() = delete;
-  CpuWorker(core::TaskQueue* q, size_t n);
+  CpuWorker(core::TaskQueue* q, const Config& config);
   ~CpuWorker();
 
   CpuWorker(const CpuWorker&) = delete;
@@ -23,7 +45,16 @@ class CpuWorker {
   CpuWorker& operator=(CpuWorker&&) = delete;
 
  private:
-  void Main(size_t);
+  // CPUs that a worker can run on, empty means any.
+  struct Placement final {
+   public:
+    size_t node = 0;
+
+    std::vector<size_t> cpus;
+  };
+
+
+  void Main(size_t index, const Placement& place);
 
 
   std::atomic<bool> alive_ = true;
@@ -33,4 +64,76 @@ class CpuWorker {
   std::vector<std::thread> threads_;
 };
 
+
+// GlWorker executes tasks of gl3Q on a thread owning an offscreen context
+// shared with the main window, so GL works such as texture uploads never block
+// the UI. It must be created and destroyed on the main thread.
+class GlWorker {
+ public:
+  // A task which is done when all GL commands issued before it are completed
+  // by GPU. It must be attached to gl3Q, and tasks on other queues can depend
+  // on it to use results of GL works.
+  class Fence : public core::iTask {
+   public:
+    friend class GlWorker;
+
+
+    Fence() = default;
+
+    Fence(const Fence&) = delete;
+    Fence(Fence&&) = delete;
+
+    Fence& operator=(const Fence&) = delete;
+    Fence& operator=(Fence&&) = delete;
+
+   protected:
+    void DoExec() override;
+
+   private:
+    // Returns true and finishes the task if GPU passed the fence within the
+    // timeout.
+    bool Wait(uint64_t timeout_ns);
+
+
+    // GLsync is an opaque pointer, which is hidden to keep GL headers out.
+    void* sync_ = nullptr;
+  };
+
+
+  GlWorker() = delete;
+  GlWorker(core::TaskQueue* q, GLFWwindow* share);
+  ~GlWorker();
+
+  GlWorker(const GlWorker&) = delete;
+  GlWorker(GlWorker&&) = delete;
+
+  GlWorker& operator=(const GlWorker&) = delete;
+  GlWorker& operator=(GlWorker&&) = delete;
+
+
+  // Returns false if the context couldn't be created. Tasks of the queue must
+  // be executed on the main thread in that case.
+  bool running() const {
+    return thread_.joinable();
+  }
+
+ private:
+  static thread_local GlWorker* current_;
+
+
+  void Main();
+
+
+  std::atomic<bool> alive_ = true;
+
+  core::TaskQueue* q_;
+
+  GLFWwindow* ctx_;
+
+  std::thread thread_;
+
+  // fences waiting for GPU, in order of issue
+  std::vector<std::shared_ptr<Fence>> fences_;
+};
+
 }  // namespace mnian
@@ -0,0 +1,141 @@
+// No copyright
+#include "mncore/buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "mncore/tensor.h"
+
+
+namespace mnian::test {
+
+static constexpr size_t kSize = 1024*1024;
+
+
+TEST(BufferPool, Reuse) {
+  auto buf = core::BufferPool::Allocate(kSize);
+  ASSERT_TRUE(buf);
+  ASSERT_EQ(
+      reinterpret_cast<uintptr_t>(buf.get())%core::BufferPool::kAlign, 0);
+  std::memset(buf.get(), 0xFF, kSize);
+
+  const auto ptr   = buf.get();
+  const auto stats = core::BufferPool::stats();
+  ASSERT_GE(stats.live, kSize);
+
+  buf = nullptr;
+  ASSERT_EQ(core::BufferPool::stats().cached, stats.cached+kSize);
+  ASSERT_EQ(core::BufferPool::stats().live, stats.live-kSize);
+
+  // A request in the same size class gets the last buffer back.
+  buf = core::BufferPool::Allocate(kSize-100);
+  ASSERT_EQ(buf.get(), ptr);
+  ASSERT_EQ(core::BufferPool::stats().hits, stats.hits+1);
+  ASSERT_EQ(core::BufferPool::stats().misses, stats.misses);
+}
+
+TEST(BufferPool, SmallBuffer) {
+  const auto stats = core::BufferPool::stats();
+
+  auto buf = core::BufferPool::Allocate(core::BufferPool::kMinSize-1);
+  ASSERT_TRUE(buf);
+  buf = nullptr;
+
+  // Small buffers are not pooled.
+  ASSERT_EQ(core::BufferPool::stats().cached, stats.cached);
+  ASSERT_EQ(core::BufferPool::stats().misses, stats.misses);
+}
+
+TEST(BufferPool, CrossThread) {
+  core::BufferPool::Buffer buf;
+  std::thread([&buf]() { buf = core::BufferPool::Allocate(kSize*3); }).join();
+
+  const auto ptr = buf.get();
+  std::thread([buf = std::move(buf)]() mutable { buf = nullptr; }).join();
+
+  // The buffer released by the dead thread is moved to the global cache.
+  buf = core::BufferPool::Allocate(kSize*3);
+  ASSERT_EQ(buf.get(), ptr);
+}
+
+TEST(BufferPool, Cap) {
+  const auto cap = core::BufferPool::cap();
+
+  auto a = core::BufferPool::Allocate(kSize*5);
+  auto b = core::BufferPool::Allocate(kSize*5);
+  a = nullptr;
+
+  core::BufferPool::Trim();
+  core::BufferPool::cap(core::BufferPool::stats().cached);
+
+  // The released buffer exceeds the cap, and is returned to the OS.
+  const auto stats = core::BufferPool::stats();
+  b = nullptr;
+  ASSERT_EQ(core::BufferPool::stats().evictions, stats.evictions+1);
+  ASSERT_EQ(core::BufferPool::stats().cached, stats.cached);
+
+  core::BufferPool::cap(cap);
+}
+
+TEST(BufferPool, CapConcurrent) {
+  const auto cap = core::BufferPool::cap();
+
+  std::vector<core::BufferPool::Buffer> bufs;
+  for (size_t i = 0; i < 16; ++i) {
+    bufs.push_back(core::BufferPool::Allocate(kSize));
+  }
+  core::BufferPool::Trim();
+  core::BufferPool::cap(core::BufferPool::stats().cached + kSize*2);
+
+  // Buffers released at once never push the cached bytes over the cap.
+  std::atomic<bool>        go = false;
+  std::vector<std::thread> th;
+  for (auto& buf : bufs) {
+    th.emplace_back([&go, buf = std::move(buf)]() mutable {
+                      while (!go) continue;
+                      buf = nullptr;
+                    });
+  }
+  go = true;
+  for (auto& t : th) t.join();
+  ASSERT_LE(core::BufferPool::stats().cached, core::BufferPool::cap());
+
+  core::BufferPool::cap(cap);
+}
+
+TEST(BufferPool, HugePages) {
+  core::BufferPool::hugePages(true);
+  ASSERT_TRUE(core::BufferPool::hugePages());
+
+  auto buf = core::BufferPool::Allocate(core::BufferPool::kHugePageSize*3);
+  ASSERT_TRUE(buf);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(buf.get()) %
+                core::BufferPool::kHugePageSize, 0);
+  std::memset(buf.get(), 0, core::BufferPool::kHugePageSize*3);
+
+  core::BufferPool::hugePages(false);
+}
+
+TEST(BufferPool, Tensor) {
+  core::Tensor::Builder b(core::Tensor::kF32, {512, 512});
+  b.at<float>({1, 1}) = 1;
+
+  auto t = b.Build();
+
+  const auto ptr = t->ptr();
+  t = nullptr;
+
+  // Recycled storage is zero-filled.
+  t = core::Tensor::Create(core::Tensor::kF32, {512, 512});
+  ASSERT_EQ(t->ptr(), ptr);
+  ASSERT_EQ(t->at<float>({1, 1}), 0.f);
+}
+
+}  // namespace mnian::test
@@ -0,0 +1,78 @@
+// No copyright
+#include "mncore/exec.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "mntest/task.h"
+
+
+namespace mnian::test {
+
+static core::iNode::ProcessRef MakeProcess() {
+  return core::iNode::ProcessRef(
+      std::make_shared<MockLambda>(0, 0),
+      std::make_shared<core::iNode::Process>());
+}
+
+
+TEST(ExecController, Coalesce) {
+  core::ExecController ctrl;
+  ASSERT_FALSE(ctrl.Poll());
+
+  ctrl.Request();
+  ctrl.Request();
+  ctrl.Request();
+  ASSERT_TRUE(ctrl.Poll());
+  ASSERT_FALSE(ctrl.Poll());
+
+  const auto& st = ctrl.stats();
+  ASSERT_EQ(st.requests, uint64_t{3});
+  ASSERT_EQ(st.dropped,  uint64_t{2});
+}
+
+TEST(ExecController, AbortRunning) {
+  core::ExecController ctrl;
+
+  ctrl.Request();
+  ASSERT_TRUE(ctrl.Poll());
+  ctrl.Start(MakeProcess());
+
+  // A new request aborts the running process only once.
+  ctrl.Request();
+  ASSERT_FALSE(ctrl.Poll());
+  ASSERT_FALSE(ctrl.Poll());
+  ASSERT_TRUE(ctrl.proc().lambda()->cancelled());
+  ASSERT_EQ(ctrl.stats().aborted, uint64_t{1});
+
+  // The pending request starts after the running one is done.
+  ctrl.Done();
+  ASSERT_TRUE(ctrl.Poll());
+  ASSERT_EQ(ctrl.stats().dropped, uint64_t{0});
+}
+
+TEST(ExecController, Speculation) {
+  core::ExecController ctrl(.5);
+
+  ctrl.Request();
+  ASSERT_TRUE(ctrl.Poll());
+
+  auto proc = std::make_shared<core::iNode::Process>();
+  proc->progress(.6);
+  ctrl.Start(
+      core::iNode::ProcessRef(std::make_shared<MockLambda>(0, 0), proc));
+
+  // The process close to done is allowed to finish.
+  ctrl.Request();
+  ASSERT_FALSE(ctrl.Poll());
+  ASSERT_FALSE(proc->abort());
+  ASSERT_EQ(ctrl.stats().aborted, uint64_t{0});
+
+  ctrl.Done();
+  ASSERT_TRUE(ctrl.Poll());
+  ASSERT_EQ(ctrl.stats().runs, uint64_t{1});
+}
+
+}  // namespace mnian::test
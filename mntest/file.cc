@@ -117,7 +117,7 @@ TEST_F(NativeFile, Truncate) {
   ASSERT_EQ(
       k.Write(reinterpret_cast<const uint8_t*>(kStr.c_str()), kStr.size()),
       kStr.size());
-  k.Truncate(kTruncateSize);
+  ASSERT_TRUE(k.Truncate(kTruncateSize));
 
   uint8_t buf[32];
   ASSERT_EQ(k.Read(buf, sizeof(buf)), kTruncateSize);
@@ -0,0 +1,53 @@
+// No copyright
+#include "mncore/function.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <utility>
+
+
+namespace mnian::test {
+
+using Func = core::SmallFunction<int(int)>;
+
+
+TEST(SmallFunction, Inline) {
+  int x = 1;
+  Func f([&x](int y) { return x+y; });
+  ASSERT_EQ(f(2), 3);
+
+  const auto stats = core::Pool::stats();
+  Func g(std::move(f));
+  ASSERT_FALSE(f);
+  ASSERT_EQ(g(3), 4);
+  ASSERT_EQ(core::Pool::stats().hits, stats.hits);
+  ASSERT_EQ(core::Pool::stats().fallbacks, stats.fallbacks);
+}
+
+TEST(SmallFunction, Large) {
+  std::array<int, 64> arr = {};
+  arr[63] = 5;
+
+  Func f([arr](int y) { return arr[63]+y; });
+  ASSERT_EQ(f(1), 6);
+
+  Func g;
+  g = std::move(f);
+  ASSERT_EQ(g(2), 7);
+}
+
+TEST(SmallFunction, Destroy) {
+  auto ptr = std::make_shared<int>(0);
+  {
+    Func f([ptr](int y) { return *ptr+y; });
+    ASSERT_EQ(ptr.use_count(), 2);
+
+    Func g(std::move(f));
+    ASSERT_EQ(ptr.use_count(), 2);
+  }
+  ASSERT_EQ(ptr.use_count(), 1);
+}
+
+}  // namespace mnian::test
@@ -0,0 +1,336 @@
+// No copyright
+#include "mncore/graph.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+namespace mnian::test {
+
+// A node which outputs a sum of two integers, and logs its executions.
+class AddNode final : public core::iNode {
+ public:
+  static constexpr const char* kType = "AddNode";
+
+
+  AddNode(Store* store, core::TaskQueue* q) :
+      iNode(ActionList {}, kType, Tag(store)), q_(q) {
+    input().push_back(
+        std::make_unique<Socket>(0, Socket::Meta {"a"}, int64_t{0}));
+    input().push_back(
+        std::make_unique<Socket>(1, Socket::Meta {"b"}, int64_t{0}));
+    output().push_back(
+        std::make_unique<Socket>(0, Socket::Meta {"sum"}, int64_t{0}));
+  }
+
+  AddNode(const AddNode&) = delete;
+  AddNode(AddNode&&) = delete;
+
+  AddNode& operator=(const AddNode&) = delete;
+  AddNode& operator=(AddNode&&) = delete;
+
+
+  std::unique_ptr<core::iNode> Clone() override {
+    return nullptr;
+  }
+
+  ProcessRef EnqueueLambda(Quality quality) override {
+    class Lambda final : public core::iLambda {
+     public:
+      Lambda(AddNode* owner, Process* proc, Quality quality) :
+          iLambda(2, 1), owner_(owner), proc_(proc), quality_(quality) {
+      }
+
+     protected:
+      void DoExec() override {
+        owner_->log_.push_back(quality_);
+        out(0, in<int64_t>(0)+in<int64_t>(1));
+        proc_->state(Process::kFinished);
+      }
+      void DoCancel() override {
+        proc_->state(Process::kAborted);
+      }
+
+     private:
+      AddNode* owner_;
+
+      Process* proc_;
+
+      Quality quality_;
+    };
+
+    auto proc   = std::make_shared<Process>();
+    auto lambda = std::make_shared<Lambda>(this, proc.get(), quality);
+    q_->Attach(lambda);
+    return ProcessRef(std::move(lambda), std::move(proc));
+  }
+
+
+  size_t count() const {
+    return log_.size();
+  }
+  const std::vector<Quality>& log() const {
+    return log_;
+  }
+
+ protected:
+  void SerializeParam(core::iSerializer*) const override {
+  }
+
+ private:
+  core::TaskQueue* q_;
+
+  std::vector<Quality> log_;
+};
+
+// A node which has no outputs, and executes its lambda on the given queue.
+class SinkNode final : public core::iNode {
+ public:
+  static constexpr const char* kType = "SinkNode";
+
+
+  SinkNode(Store* store, core::TaskQueue* q) :
+      iNode(ActionList {}, kType, Tag(store)), q_(q) {
+    input().push_back(
+        std::make_unique<Socket>(0, Socket::Meta {"in"}, int64_t{0}));
+  }
+
+  SinkNode(const SinkNode&) = delete;
+  SinkNode(SinkNode&&) = delete;
+
+  SinkNode& operator=(const SinkNode&) = delete;
+  SinkNode& operator=(SinkNode&&) = delete;
+
+
+  std::unique_ptr<core::iNode> Clone() override {
+    return nullptr;
+  }
+
+  ProcessRef EnqueueLambda(Quality) override {
+    class Lambda final : public core::iLambda {
+     public:
+      Lambda(SinkNode* owner, Process* proc) :
+          iLambda(1, 0), owner_(owner), proc_(proc) {
+      }
+
+     protected:
+      void DoExec() override {
+        owner_->value_ = in<int64_t>(0);
+        proc_->state(Process::kFinished);
+      }
+      void DoCancel() override {
+        proc_->state(Process::kAborted);
+      }
+
+     private:
+      SinkNode* owner_;
+
+      Process* proc_;
+    };
+
+    auto proc   = std::make_shared<Process>();
+    auto lambda = std::make_shared<Lambda>(this, proc.get());
+    q_->Attach(lambda);
+    return ProcessRef(std::move(lambda), std::move(proc));
+  }
+
+
+  int64_t value() const {
+    return value_;
+  }
+
+ protected:
+  void SerializeParam(core::iSerializer*) const override {
+  }
+
+ private:
+  core::TaskQueue* q_;
+
+  int64_t value_ = 0;
+};
+
+
+class NodeGraph : public ::testing::Test {
+ protected:
+  int64_t Result(core::iNode* node) {
+    return std::get<int64_t>(*graph_.output(node, 0));
+  }
+
+  void Run() {
+    auto join = graph_.Run(&queue_);
+    while (queue_.Dequeue()) continue;
+    ASSERT_EQ(join->state(), core::iTask::kDone);
+    ASSERT_FALSE(graph_.busy());
+  }
+
+
+  core::iNode::Store store_;
+
+  core::TaskQueue queue_;
+
+  core::NodeGraph graph_;
+};
+
+TEST_F(NodeGraph, Incremental) {
+  // a -> b -> c
+  //      d -> c
+  AddNode a(&store_, &queue_), b(&store_, &queue_),
+          c(&store_, &queue_), d(&store_, &queue_);
+  for (auto n : {&a, &b, &c, &d}) graph_.Add(n);
+  ASSERT_TRUE(graph_.Connect(&a, 0, &b, 0));
+  ASSERT_TRUE(graph_.Connect(&b, 0, &c, 0));
+  ASSERT_TRUE(graph_.Connect(&d, 0, &c, 1));
+
+  graph_.SetInput(&a, 0, int64_t{1});
+  graph_.SetInput(&b, 1, int64_t{2});
+  graph_.SetInput(&d, 0, int64_t{4});
+  Run();
+  ASSERT_EQ(graph_.dirtyCount(), size_t{0});
+  ASSERT_EQ(Result(&c), 7);
+  for (auto n : {&a, &b, &c, &d}) ASSERT_EQ(n->count(), size_t{1});
+
+  // Only the downstream cone of b is executed.
+  graph_.SetInput(&b, 1, int64_t{3});
+  ASSERT_EQ(graph_.dirtyCount(), size_t{2});
+  Run();
+  ASSERT_EQ(Result(&c), 8);
+  ASSERT_EQ(a.count(), size_t{1});
+  ASSERT_EQ(b.count(), size_t{2});
+  ASSERT_EQ(c.count(), size_t{2});
+  ASSERT_EQ(d.count(), size_t{1});
+
+  ASSERT_EQ(graph_.version(&a, 0), core::NodeGraph::Version{1});
+  ASSERT_EQ(graph_.version(&b, 0), core::NodeGraph::Version{2});
+  ASSERT_EQ(graph_.seen(&c, 0), graph_.version(&b, 0));
+
+  // Nothing is executed when nothing changes.
+  Run();
+  ASSERT_EQ(c.count(), size_t{2});
+}
+
+TEST_F(NodeGraph, Cycle) {
+  AddNode a(&store_, &queue_), b(&store_, &queue_);
+  graph_.Add(&a);
+  graph_.Add(&b);
+
+  ASSERT_TRUE(graph_.Connect(&a, 0, &b, 0));
+  ASSERT_FALSE(graph_.Connect(&b, 0, &a, 0));
+  ASSERT_FALSE(graph_.Connect(&a, 0, &a, 1));
+}
+
+TEST_F(NodeGraph, Abort) {
+  AddNode a(&store_, &queue_), b(&store_, &queue_);
+  graph_.Add(&a);
+  graph_.Add(&b);
+  ASSERT_TRUE(graph_.Connect(&a, 0, &b, 0));
+
+  auto join = graph_.Run(&queue_);
+  graph_.Abort();
+  while (queue_.Dequeue()) continue;
+
+  // Aborted nodes remain dirty.
+  ASSERT_TRUE(join->cancelled());
+  ASSERT_TRUE(graph_.dirty(&a));
+  ASSERT_TRUE(graph_.dirty(&b));
+  ASSERT_EQ(b.count(), size_t{0});
+
+  Run();
+  ASSERT_EQ(graph_.dirtyCount(), size_t{0});
+}
+
+TEST_F(NodeGraph, Delete) {
+  auto a = std::make_unique<AddNode>(&store_, &queue_);
+  AddNode b(&store_, &queue_);
+  graph_.Add(a.get());
+  graph_.Add(&b);
+  ASSERT_TRUE(graph_.Connect(a.get(), 0, &b, 0));
+  graph_.SetInput(a.get(), 0, int64_t{5});
+  Run();
+  ASSERT_EQ(Result(&b), 5);
+
+  // Deleting the node disconnects it.
+  a = nullptr;
+  ASSERT_TRUE(graph_.dirty(&b));
+  Run();
+  ASSERT_EQ(Result(&b), 0);
+}
+
+
+TEST_F(NodeGraph, NoOutputs) {
+  core::TaskQueue sub;
+
+  AddNode  a(&store_, &queue_);
+  SinkNode b(&store_, &sub);
+  graph_.Add(&a);
+  graph_.Add(&b);
+  ASSERT_TRUE(graph_.Connect(&a, 0, &b, 0));
+  graph_.SetInput(&a, 0, int64_t{3});
+
+  // The sink is not collected until its lambda is executed.
+  auto join = graph_.Run(&queue_);
+  while (queue_.Dequeue()) continue;
+  ASSERT_NE(join->state(), core::iTask::kDone);
+  ASSERT_TRUE(graph_.dirty(&b));
+
+  while (sub.Dequeue()) continue;
+  while (queue_.Dequeue()) continue;
+  ASSERT_EQ(join->state(), core::iTask::kDone);
+  ASSERT_FALSE(graph_.dirty(&b));
+  ASSERT_EQ(b.value(), 3);
+}
+
+TEST(iNode, SocketCount) {
+  core::iNode::Store store;
+  core::TaskQueue    queue;
+  AddNode            node(&store, &queue);
+
+  ASSERT_EQ(node.inputCount(),  size_t{2});
+  ASSERT_EQ(node.outputCount(), size_t{1});
+}
+
+TEST(iNode, EnqueueProgressive) {
+  core::iNode::Store store;
+  core::TaskQueue    queue;
+  AddNode            node(&store, &queue);
+
+  auto proc = node.EnqueueProgressive();
+  ASSERT_TRUE(proc.refinement());
+  proc.refinement()->lambda()->Trigger();
+  proc.lambda()->Trigger();
+
+  // The preview comes first, and then the full quality one.
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_TRUE(proc.busy());
+  ASSERT_EQ(proc.state(), core::iNode::Process::kPending);
+
+  while (queue.Dequeue()) continue;
+  ASSERT_FALSE(proc.busy());
+  ASSERT_EQ(proc.state(), core::iNode::Process::kFinished);
+  ASSERT_EQ(node.log(), (std::vector<core::iNode::Quality> {
+                             core::iNode::kPreview, core::iNode::kFull,
+                           }));
+}
+
+TEST(iNode, AbortProgressive) {
+  core::iNode::Store store;
+  core::TaskQueue    queue;
+  AddNode            node(&store, &queue);
+
+  auto proc = node.EnqueueProgressive();
+  proc.refinement()->lambda()->Trigger();
+  proc.lambda()->Trigger();
+
+  ASSERT_TRUE(queue.Dequeue());
+  proc.RequestAbort();
+  while (queue.Dequeue()) continue;
+
+  ASSERT_FALSE(proc.busy());
+  ASSERT_EQ(proc.state(), core::iNode::Process::kAborted);
+  ASSERT_EQ(node.count(), size_t{1});
+}
+
+}  // namespace mnian::test
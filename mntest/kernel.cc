@@ -0,0 +1,220 @@
+// No copyright
+#include "mncore/kernel.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+namespace mnian::test {
+
+// Returns all instruction sets available on this machine.
+static std::vector<core::Kernel::Isa> GetIsas() {
+  std::vector<core::Kernel::Isa> ret;
+  for (auto isa : {core::Kernel::kScalar, core::Kernel::kSse2,
+                   core::Kernel::kAvx2, core::Kernel::kAvx512}) {
+    if (core::Kernel::GetTable(isa)) ret.push_back(isa);
+  }
+  return ret;
+}
+
+static std::vector<float> MakeRandom(size_t n, uint32_t seed) {
+  std::mt19937 rnd(seed);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+  std::vector<float> ret(n);
+  for (auto& x : ret) x = dist(rnd);
+  return ret;
+}
+
+
+// Sizes to cover empty spans and partial blocks of every instruction set.
+static constexpr size_t kSizes[] = {0, 1, 3, 4, 7, 8, 15, 16, 17, 33, 1000};
+
+
+TEST(Kernel, DetectIsa) {
+  const auto isa = core::Kernel::DetectIsa();
+  ASSERT_TRUE(core::Kernel::GetTable(isa));
+  ASSERT_EQ(core::Kernel().isa(), isa);
+  RecordProperty("isa", core::Kernel::StringifyIsa(isa));
+}
+
+TEST(Kernel, Elementwise) {
+  for (auto isa : GetIsas()) {
+    const core::Kernel k(isa);
+    SCOPED_TRACE(core::Kernel::StringifyIsa(isa));
+
+    for (auto n : kSizes) {
+      const auto a = MakeRandom(n, 1);
+      const auto b = MakeRandom(n, 2);
+      const auto c = MakeRandom(n, 3);
+
+      std::vector<float> out(n);
+      k.Add(a, b, out);
+      for (size_t i = 0; i < n; ++i) ASSERT_EQ(out[i], a[i]+b[i]);
+
+      k.Mul(a, b, out);
+      for (size_t i = 0; i < n; ++i) ASSERT_EQ(out[i], a[i]*b[i]);
+
+      k.Fma(a, b, c, out);
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_NEAR(out[i], a[i]*b[i]+c[i], 1e-6f);
+      }
+
+      k.Clamp(a, -.5f, .5f, out);
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(out[i], std::clamp(a[i], -.5f, .5f));
+      }
+
+      k.Lerp(a, b, .25f, out);
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_NEAR(out[i], a[i]+(b[i]-a[i])*.25f, 1e-6f);
+      }
+
+      // in place
+      out = a;
+      k.Add(out, b, out);
+      for (size_t i = 0; i < n; ++i) ASSERT_EQ(out[i], a[i]+b[i]);
+    }
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::vector<float> in = {nan}, out(1);
+    k.Clamp(in, 0, 1, out);
+    ASSERT_EQ(out[0], 0.f);
+  }
+}
+
+TEST(Kernel, Convert) {
+  for (auto isa : GetIsas()) {
+    const core::Kernel k(isa);
+    SCOPED_TRACE(core::Kernel::StringifyIsa(isa));
+
+    for (auto n : kSizes) {
+      const auto a = MakeRandom(n, 1);
+
+      std::vector<double> f64(n);
+      k.Convert(a, f64);
+      for (size_t i = 0; i < n; ++i) ASSERT_EQ(f64[i], double{a[i]});
+
+      for (auto& x : f64) x /= 3;
+      std::vector<float> f32(n);
+      k.Convert(f64, f32);
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(f32[i], static_cast<float>(f64[i]));
+      }
+
+      std::vector<int32_t> i32(n);
+      for (size_t i = 0; i < n; ++i) {
+        i32[i] = static_cast<int32_t>(a[i]*1e8f);
+      }
+      k.Convert(i32, f32);
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(f32[i], static_cast<float>(i32[i]));
+      }
+
+      std::vector<uint8_t> u8(n);
+      for (size_t i = 0; i < n; ++i) u8[i] = static_cast<uint8_t>(i*7);
+      k.Convert(u8, f32);
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(f32[i], static_cast<float>(u8[i]));
+      }
+
+      for (size_t i = 0; i < n; ++i) f32[i] = a[i]*300.f;
+      k.Convert(f32, u8);
+      for (size_t i = 0; i < n; ++i) {
+        const float v = std::clamp(std::nearbyint(f32[i]), 0.f, 255.f);
+        ASSERT_EQ(u8[i], static_cast<uint8_t>(v));
+      }
+    }
+
+    // rounds half to even, and saturates
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::vector<float>   in = {.5f, 1.5f, 2.5f, -3.f, 1e10f, nan};
+    std::vector<uint8_t> out(in.size());
+    k.Convert(in, out);
+    ASSERT_EQ(out, (std::vector<uint8_t> {0, 2, 2, 0, 255, 0}));
+  }
+}
+
+TEST(Kernel, Reduce) {
+  for (auto isa : GetIsas()) {
+    const core::Kernel k(isa);
+    SCOPED_TRACE(core::Kernel::StringifyIsa(isa));
+
+    for (auto n : kSizes) {
+      const auto a = MakeRandom(n, 1);
+      const auto b = MakeRandom(n, 2);
+
+      double sum = 0, dot = 0;
+      float  min = std::numeric_limits<float>::infinity(), max = -min;
+      for (size_t i = 0; i < n; ++i) {
+        sum += a[i];
+        dot += a[i]*b[i];
+        min  = std::min(min, a[i]);
+        max  = std::max(max, a[i]);
+      }
+      ASSERT_NEAR(k.Sum(a), sum, 1e-4);
+      ASSERT_NEAR(k.Dot(a, b), dot, 1e-4);
+      ASSERT_EQ(k.Min(a), min);
+      ASSERT_EQ(k.Max(a), max);
+    }
+  }
+}
+
+
+// Measures throughput of each kernel in GB/s, counting bytes read and
+// written. Run it explicitly by --gtest_also_run_disabled_tests.
+TEST(Kernel, DISABLED_Throughput) {
+  constexpr size_t kN     = size_t{1} << 20;
+  constexpr size_t kTrial = 100;
+
+  const auto a = MakeRandom(kN, 1);
+  const auto b = MakeRandom(kN, 2);
+  const auto c = MakeRandom(kN, 3);
+
+  std::vector<float>   out(kN);
+  std::vector<double>  f64(kN);
+  std::vector<uint8_t> u8(kN);
+
+  for (auto isa : GetIsas()) {
+    const core::Kernel k(isa);
+
+    volatile float sink = 0;
+    const auto measure = [&](const char* name,
+                             size_t bytes,
+                             const std::function<void()>& f) {
+      f();  // warm up
+
+      const auto begin = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < kTrial; ++i) f();
+      const auto end = std::chrono::steady_clock::now();
+
+      const double sec = std::chrono::duration<double>(end-begin).count();
+      std::printf("%-8s %-8s %8.2f GB/s\n",
+                  core::Kernel::StringifyIsa(isa), name,
+                  static_cast<double>(bytes*kTrial)/sec/1e9);
+    };
+
+    constexpr size_t f = sizeof(float);
+    measure("add",   kN*f*3, [&]() { k.Add(a, b, out); });
+    measure("mul",   kN*f*3, [&]() { k.Mul(a, b, out); });
+    measure("fma",   kN*f*4, [&]() { k.Fma(a, b, c, out); });
+    measure("clamp", kN*f*2, [&]() { k.Clamp(a, 0, 1, out); });
+    measure("lerp",  kN*f*3, [&]() { k.Lerp(a, b, .5f, out); });
+    measure("f32f64", kN*(f+sizeof(double)), [&]() { k.Convert(a, f64); });
+    measure("f32u8",  kN*(f+1), [&]() { k.Convert(a, u8); });
+    measure("sum",   kN*f,   [&]() { sink = k.Sum(a); });
+    measure("max",   kN*f,   [&]() { sink = k.Max(a); });
+    measure("dot",   kN*f*2, [&]() { sink = k.Dot(a, b); });
+  }
+}
+
+}  // namespace mnian::test
@@ -0,0 +1,131 @@
+// No copyright
+#include "mncore/memo.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mntest/node.h"
+
+
+namespace mnian::test {
+
+// Makes a key whose hash is given directly, to emulate collisions.
+static core::MemoCache::Key MakeKey(uint64_t hash, int64_t in = 0) {
+  return core::MemoCache::Key {hash, "node", {in}};
+}
+
+static core::MemoCache::Outputs MakeOutputs(size_t bytes) {
+  return {core::iLambda::MakeValue(
+      core::SharedAny(std::make_shared<std::string>(bytes, 'a')))};
+}
+
+
+TEST(Hasher, Content) {
+  const auto hash = [](const core::SharedAny& v) {
+    core::Hasher hasher;
+    hasher.AddValue(v);
+    return hasher.value();
+  };
+
+  const auto str1 = std::make_shared<std::string>("helloworld");
+  const auto str2 = std::make_shared<std::string>("helloworld");
+  ASSERT_EQ(hash(str1), hash(str2));
+  ASSERT_NE(hash(str1), hash(std::make_shared<std::string>("hello")));
+
+  ASSERT_EQ(hash(int64_t{1}), hash(int64_t{1}));
+  ASSERT_NE(hash(int64_t{1}), hash(int64_t{2}));
+  ASSERT_NE(hash(int64_t{0}), hash(0.));
+}
+
+TEST(MemoCache, MakeKey) {
+  core::iNode::Store nstore;
+  MockNode node(&nstore);
+
+  EXPECT_CALL(node, SerializeParam(::testing::_)).
+      WillRepeatedly([](core::iSerializer* serial) {
+                       serial->SerializeValue(int64_t{0});
+                     });
+
+  const std::vector<core::SharedAny> in1 = {int64_t{0}, 1.};
+  const std::vector<core::SharedAny> in2 = {int64_t{0}, 2.};
+  ASSERT_EQ(core::MemoCache::MakeKey(node, in1),
+            core::MemoCache::MakeKey(node, in1));
+  ASSERT_NE(core::MemoCache::MakeKey(node, in1),
+            core::MemoCache::MakeKey(node, in2));
+
+  // Strings are compared by contents.
+  const std::vector<core::SharedAny> str1 = {
+    std::make_shared<std::string>("hello"),
+  };
+  const std::vector<core::SharedAny> str2 = {
+    std::make_shared<std::string>("hello"),
+  };
+  ASSERT_EQ(core::MemoCache::MakeKey(node, str1),
+            core::MemoCache::MakeKey(node, str2));
+}
+
+TEST(MemoCache, FindAndStore) {
+  core::MemoCache cache;
+
+  ASSERT_FALSE(cache.Find(MakeKey(0)));
+  cache.Store(MakeKey(0), MakeOutputs(8), std::chrono::milliseconds(10));
+
+  auto out = cache.Find(MakeKey(0));
+  ASSERT_TRUE(out);
+  ASSERT_EQ(out->size(), size_t{1});
+  ASSERT_EQ(*std::get<std::shared_ptr<std::string>>(*(*out)[0]), "aaaaaaaa");
+
+  const auto st = cache.stats();
+  ASSERT_EQ(st.hits,    uint64_t{1});
+  ASSERT_EQ(st.misses,  uint64_t{1});
+  ASSERT_EQ(st.entries, uint64_t{1});
+  ASSERT_EQ(st.saved,   std::chrono::milliseconds(10));
+  ASSERT_DOUBLE_EQ(st.hitRatio(), .5);
+}
+
+TEST(MemoCache, Collision) {
+  core::MemoCache cache;
+  cache.Store(MakeKey(0, 1), MakeOutputs(8), {});
+
+  // The same hash with other inputs is a miss.
+  ASSERT_FALSE(cache.Find(MakeKey(0, 2)));
+  ASSERT_TRUE(cache.Find(MakeKey(0, 1)));
+
+  auto key = MakeKey(0, 1);
+  key.node = "other";
+  ASSERT_FALSE(cache.Find(key));
+
+  const auto st = cache.stats();
+  ASSERT_EQ(st.hits,   uint64_t{1});
+  ASSERT_EQ(st.misses, uint64_t{2});
+}
+
+TEST(MemoCache, Evict) {
+  core::MemoCache cache(3000);
+
+  cache.Store(MakeKey(0), MakeOutputs(1000), {});
+  cache.Store(MakeKey(1), MakeOutputs(1000), {});
+  ASSERT_TRUE(cache.Find(MakeKey(0)));
+
+  // The least recently used one is evicted.
+  cache.Store(MakeKey(2), MakeOutputs(1000), {});
+  ASSERT_TRUE(cache.Find(MakeKey(0)));
+  ASSERT_FALSE(cache.Find(MakeKey(1)));
+  ASSERT_TRUE(cache.Find(MakeKey(2)));
+  ASSERT_EQ(cache.stats().evictions, uint64_t{1});
+  ASSERT_LE(cache.stats().bytes, uint64_t{3000});
+
+  // Outputs larger than the budget are not stored.
+  cache.Store(MakeKey(3), MakeOutputs(5000), {});
+  ASSERT_FALSE(cache.Find(MakeKey(3)));
+
+  cache.budget(0);
+  ASSERT_EQ(cache.stats().entries, uint64_t{0});
+}
+
+}  // namespace mnian::test
@@ -0,0 +1,42 @@
+// No copyright
+#include "mncore/metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+
+namespace mnian::test {
+
+TEST(Histogram, Bucket) {
+  ASSERT_EQ(core::Histogram::Bucket(0), size_t{0});
+  ASSERT_EQ(core::Histogram::Bucket(1), size_t{1});
+  ASSERT_EQ(core::Histogram::Bucket(2), size_t{2});
+  ASSERT_EQ(core::Histogram::Bucket(3), size_t{2});
+  ASSERT_EQ(core::Histogram::Bucket(1024), size_t{11});
+  ASSERT_EQ(core::Histogram::Bucket(UINT64_MAX), core::Histogram::kBuckets-1);
+}
+
+TEST(Histogram, Add) {
+  core::Histogram h;
+  h.Add(0);
+  h.Add(5);
+  h.Add(6);
+
+  const auto s = h.sample();
+  ASSERT_EQ(s[0], uint64_t{1});
+  ASSERT_EQ(s[3], uint64_t{2});
+}
+
+TEST(TaskMetrics, IdleRatio) {
+  core::TaskMetrics::Sample a, b;
+  a.time_ns   = 1000;
+  a.parked_ns = 500;
+  b.time_ns   = 2000;
+  b.parked_ns = 1500;
+  b.workers   = 4;
+  ASSERT_DOUBLE_EQ(core::TaskMetrics::Sample::IdleRatio(a, b), .25);
+  ASSERT_DOUBLE_EQ(core::TaskMetrics::Sample::IdleRatio(b, a), 0.);
+}
+
+}  // namespace mnian::test
@@ -0,0 +1,115 @@
+// No copyright
+#include "mncore/parallel.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+
+namespace mnian::test {
+
+TEST(Parallel, For) {
+  core::TaskQueue queue;
+
+  std::vector<size_t> v(1000);
+  auto join = core::ParallelFor(
+      &queue, 0, v.size(), 64,
+      [&v](size_t b, size_t e) {
+        ASSERT_LE(e-b, size_t{64});
+        ASSERT_EQ(b%64, size_t{0});
+        for (auto i = b; i < e; ++i) v[i] = i;
+      });
+  while (queue.Dequeue()) continue;
+
+  ASSERT_EQ(join->state(), core::iTask::kDone);
+  for (size_t i = 0; i < v.size(); ++i) ASSERT_EQ(v[i], i);
+}
+
+TEST(Parallel, ForEmpty) {
+  core::TaskQueue queue;
+
+  auto join = core::ParallelFor(
+      &queue, 0, 0, 1, [](size_t, size_t) { ASSERT_TRUE(false); });
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(join->state(), core::iTask::kDone);
+}
+
+TEST(Parallel, Reduce) {
+  core::TaskQueue queue;
+
+  auto sum = core::ParallelReduce(
+      &queue, 0, 100, 7, std::string {},
+      [](size_t b, size_t e) {
+        std::string ret;
+        for (auto i = b; i < e; ++i) ret += static_cast<char>('0'+i%10);
+        return ret;
+      },
+      [](std::string&& a, std::string&& b) { return a+b; });
+  while (queue.Dequeue()) continue;
+
+  std::string expect;
+  for (size_t i = 0; i < 100; ++i) expect += static_cast<char>('0'+i%10);
+  ASSERT_EQ(sum->result(), expect);
+}
+
+TEST(Parallel, Abort) {
+  core::TaskQueue queue;
+
+  core::ParallelOptions opts;
+  opts.proc = std::make_shared<core::iNode::Process>();
+
+  size_t count = 0;
+  auto join = core::ParallelFor(
+      &queue, 0, 100, 1,
+      [&count, proc = opts.proc.get()](size_t, size_t) {
+        if (++count == 10) proc->RequestAbort();
+      },
+      opts);
+  while (queue.Dequeue()) continue;
+
+  ASSERT_EQ(count, size_t{10});
+  ASSERT_EQ(join->state(), core::iTask::kDone);
+  ASSERT_TRUE(join->cancelled());
+  ASSERT_DOUBLE_EQ(opts.proc->progress(), .1);
+}
+
+TEST(Parallel, ReduceOnWorkers) {
+  static constexpr size_t kWorkers = 4;
+  static constexpr size_t kCount   = 100000;
+
+  core::TaskQueue queue;
+
+  std::atomic<bool> alive = true;
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < kWorkers; ++i) {
+    workers.emplace_back([&]() {
+                           core::TaskQueue::Worker w(&queue);
+                           while (alive || queue.size()) {
+                             if (!w.Dequeue()) w.Park();
+                           }
+                         });
+  }
+
+  auto sum = core::ParallelReduce(
+      &queue, 0, kCount, 100, uint64_t{0},
+      [](size_t b, size_t e) {
+        uint64_t ret = 0;
+        for (auto i = b; i < e; ++i) ret += i;
+        return ret;
+      },
+      [](uint64_t a, uint64_t b) { return a+b; });
+  while (sum->state() != core::iTask::kDone) std::this_thread::yield();
+
+  alive = false;
+  queue.WakeUp();
+  for (auto& th : workers) th.join();
+
+  ASSERT_EQ(sum->result(), uint64_t{kCount*(kCount-1)/2});
+}
+
+}  // namespace mnian::test
@@ -0,0 +1,111 @@
+// No copyright
+#include "mncore/pool.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+
+namespace mnian::test {
+
+TEST(Pool, Reuse) {
+  auto ptr = core::Pool::Allocate(40);
+  ASSERT_TRUE(ptr);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr)%core::Pool::kAlign, 0);
+  std::memset(ptr, 0xFF, 40);
+  core::Pool::Deallocate(ptr, 40);
+
+  const auto stats = core::Pool::stats();
+  for (size_t i = 0; i < 1000; ++i) {
+    auto p = core::Pool::Allocate(40);
+    core::Pool::Deallocate(p, 40);
+  }
+
+  // All objects are served from free lists without new chunks.
+  const auto after = core::Pool::stats();
+  ASSERT_EQ(after.chunk_allocs, stats.chunk_allocs);
+  ASSERT_EQ(after.hits,      stats.hits+1000);
+  ASSERT_EQ(after.fallbacks, stats.fallbacks);
+  ASSERT_EQ(after.frees,     stats.frees+1000);
+}
+
+TEST(Pool, LargeBlock) {
+  const auto stats = core::Pool::stats();
+
+  auto ptr = core::Pool::Allocate(core::Pool::kMaxSize+1);
+  ASSERT_TRUE(ptr);
+  core::Pool::Deallocate(ptr, core::Pool::kMaxSize+1);
+
+  const auto after = core::Pool::stats();
+  ASSERT_EQ(after.chunk_allocs, stats.chunk_allocs+1);
+  ASSERT_EQ(after.hits,         stats.hits);
+  ASSERT_EQ(after.fallbacks,    stats.fallbacks+1);
+  ASSERT_EQ(after.frees,        stats.frees+1);
+}
+
+TEST(Pool, CrossThread) {
+  static constexpr size_t kCount = 10000;
+
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < kCount; ++i) {
+    ptrs.push_back(core::Pool::Allocate(i%core::Pool::kMaxSize+1));
+  }
+  std::thread([&ptrs]() {
+                for (size_t i = 0; i < kCount; ++i) {
+                  core::Pool::Deallocate(ptrs[i], i%core::Pool::kMaxSize+1);
+                }
+              }).join();
+
+  // Counters of the dead thread are kept.
+  ASSERT_GE(core::Pool::stats().frees, kCount);
+
+  // Blocks released by the dead thread are reusable.
+  const auto stats = core::Pool::stats();
+  for (size_t i = 0; i < kCount; ++i) {
+    ptrs[i] = core::Pool::Allocate(i%core::Pool::kMaxSize+1);
+  }
+  ASSERT_EQ(core::Pool::stats().chunk_allocs, stats.chunk_allocs);
+
+  for (size_t i = 0; i < kCount; ++i) {
+    core::Pool::Deallocate(ptrs[i], i%core::Pool::kMaxSize+1);
+  }
+}
+
+TEST(Pool, Arena) {
+  static constexpr size_t kCount = 10000;
+
+  auto alloc = [](size_t arena) {
+    core::Pool::arena(arena);
+    ASSERT_EQ(core::Pool::arena(), arena);
+
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < kCount; ++i) {
+      ptrs.push_back(core::Pool::Allocate(16));
+    }
+    for (auto ptr : ptrs) core::Pool::Deallocate(ptr, 16);
+  };
+  std::thread(alloc, 3).join();
+
+  // Blocks released in an arena are reused only in the arena.
+  auto stats = core::Pool::stats();
+  std::thread(alloc, 3).join();
+  ASSERT_EQ(core::Pool::stats().chunk_allocs, stats.chunk_allocs);
+
+  std::thread(alloc, 4).join();
+  ASSERT_GT(core::Pool::stats().chunk_allocs, stats.chunk_allocs);
+}
+
+TEST(PoolAllocator, MakePooled) {
+  auto ptr = core::MakePooled<std::vector<int>>(size_t{4}, 1);
+  ASSERT_EQ(ptr->size(), size_t{4});
+
+  std::vector<int, core::PoolAllocator<int>> v;
+  for (int i = 0; i < 100; ++i) v.push_back(i);
+  ASSERT_EQ(v[99], 99);
+}
+
+}  // namespace mnian::test
@@ -5,9 +5,14 @@
 #include <gtest/gtest.h>
 
 #include <atomic>  // NOLINT(build/c++11)
+#include <chrono>  // NOLINT(build/c++11)
+#include <future>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <iostream>
@@ -15,6 +20,770 @@
 
 namespace mnian::test {
 
+TEST(TaskQueue, DequeueOnlyReady) {
+  core::TaskQueue queue;
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+
+  queue.Attach(child);
+  queue.Attach(parent);
+  ASSERT_EQ(queue.size(), size_t{2});
+  ASSERT_FALSE(queue.Dequeue());
+
+  child->Trigger();
+  ASSERT_FALSE(queue.Dequeue());
+
+  ::testing::InSequence _;
+  EXPECT_CALL(*parent, DoExec());
+  EXPECT_CALL(*child, DoExec());
+
+  parent->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_FALSE(queue.Dequeue());
+  ASSERT_EQ(queue.size(), size_t{0});
+}
+
+TEST(TaskQueue, AttachReadyTask) {
+  core::TaskQueue queue;
+
+  auto task = std::make_shared<::testing::StrictMock<MockTask>>();
+  EXPECT_CALL(*task, DoExec());
+
+  task->Trigger();
+  ASSERT_TRUE(task->ready());
+
+  queue.Attach(task);
+  task = nullptr;
+
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_FALSE(queue.Dequeue());
+}
+
+
+TEST(TaskQueue, StealFromWorker) {
+  core::TaskQueue queue;
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+
+  queue.Attach(parent);
+  queue.Attach(child);
+  child->Trigger();
+  parent->Trigger();
+
+  ::testing::InSequence _;
+  EXPECT_CALL(*parent, DoExec());
+  EXPECT_CALL(*child, DoExec());
+
+  {
+    core::TaskQueue::Worker w(&queue);
+    ASSERT_TRUE(w.Dequeue());  // the child is pushed to the worker's deque
+    ASSERT_TRUE(queue.Dequeue());  // and stolen
+    ASSERT_FALSE(w.Dequeue());
+  }
+  ASSERT_EQ(queue.size(), size_t{0});
+}
+
+TEST(TaskQueue, ParkUntilReady) {
+  core::TaskQueue queue;
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+
+  queue.Attach(child);
+  child->Trigger();
+
+  std::atomic<bool> done = false;
+  EXPECT_CALL(*parent, DoExec());
+  EXPECT_CALL(*child, DoExec()).WillOnce([&done]() { done = true; });
+
+  std::thread th([&queue, &done]() {
+                   core::TaskQueue::Worker w(&queue);
+                   while (!done) {
+                     if (!w.Dequeue()) w.Park();
+                   }
+                 });
+
+  // The child gets ready by Resolve() on the main thread, and it must wake up
+  // the worker without any polling.
+  queue.Attach(parent);
+  parent->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+
+  th.join();
+  ASSERT_EQ(queue.size(), size_t{0});
+}
+
+TEST(TaskQueue, WakeUpParkingWorkers) {
+  core::TaskQueue queue;
+
+  std::atomic<bool> alive = true;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&queue, &alive]() {
+                           core::TaskQueue::Worker w(&queue);
+                           while (alive) {
+                             if (!w.Dequeue()) w.Park();
+                           }
+                         });
+  }
+  alive = false;
+  queue.WakeUp();
+  for (auto& th : threads) th.join();
+}
+
+TEST(TaskQueue, AddChildToDone) {
+  core::TaskQueue queue;
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  EXPECT_CALL(*parent, DoExec());
+
+  queue.Attach(parent);
+  parent->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(parent->state(), core::iTask::kDone);
+
+  auto child = std::make_shared<::testing::StrictMock<MockTask>>();
+  EXPECT_CALL(*child, DoExec());
+
+  parent->AddChild(child);
+  child->Trigger();
+  ASSERT_TRUE(child->ready());
+
+  queue.Attach(child);
+  ASSERT_TRUE(queue.Dequeue());
+}
+
+TEST(TaskQueue, ConnectToDone) {
+  core::TaskQueue queue;
+
+  auto producer = std::make_shared<::testing::StrictMock<MockLambda>>(0, 1);
+  auto ptr      = producer.get();
+  EXPECT_CALL(*producer, DoExec()).
+      WillOnce([ptr]() { ptr->out(0, int64_t{42}); });
+
+  queue.Attach(producer);
+  producer->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+
+  auto consumer = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  producer->Connect(0, consumer, 0);
+  ASSERT_EQ(consumer->in<int64_t>(0), int64_t{42});
+}
+
+TEST(TaskQueue, ExecWithoutHeapAllocation) {
+  core::TaskQueue queue;
+
+  size_t count = 0;
+  auto frame = [&]() {
+    for (size_t i = 0; i < 100; ++i) {
+      queue.Exec([&count]() { ++count; });
+    }
+    while (queue.Dequeue()) continue;
+  };
+  frame();  // warm up
+
+  const auto stats = core::Pool::stats();
+  frame();
+  ASSERT_EQ(core::Pool::stats().chunk_allocs, stats.chunk_allocs);
+  ASSERT_EQ(count, size_t{200});
+}
+
+TEST(TaskQueue, Drain) {
+  core::TaskQueue queue;
+
+  size_t count = 0;
+  for (size_t i = 0; i < 10; ++i) {
+    queue.Exec([&count]() {
+                 std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                 ++count;
+               });
+  }
+  ASSERT_EQ(queue.readyCount(), size_t{10});
+
+  const auto n = queue.Drain(std::chrono::milliseconds(25));
+  ASSERT_EQ(n, count);
+  ASSERT_GE(n, size_t{1});
+  ASSERT_LE(n, size_t{3});
+  ASSERT_EQ(queue.readyCount(), 10-n);
+
+  ASSERT_EQ(queue.Drain(std::chrono::seconds(10)), 10-n);
+  ASSERT_EQ(queue.readyCount(), size_t{0});
+}
+
+TEST(TaskQueue, Notifier) {
+  core::TaskQueue queue;
+
+  size_t notified = 0;
+  queue.notifier([&notified]() { ++notified; });
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+  queue.Attach(parent);
+  queue.Attach(child);
+  child->Trigger();
+  ASSERT_EQ(notified, size_t{0});
+
+  EXPECT_CALL(*parent, DoExec());
+  EXPECT_CALL(*child, DoExec());
+
+  parent->Trigger();
+  ASSERT_EQ(notified, size_t{1});
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(notified, size_t{2});
+  ASSERT_TRUE(queue.Dequeue());
+}
+
+TEST(TaskQueue, Metrics) {
+  core::TaskQueue queue;
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+
+  EXPECT_CALL(*parent, DoExec());
+  EXPECT_CALL(*child, DoExec());
+
+  queue.Attach(parent);
+  queue.Attach(child);
+  parent->Trigger();
+  child->Trigger();
+
+  auto s = queue.sample();
+  ASSERT_EQ(s.depth,    uint64_t{1});
+  ASSERT_EQ(s.attached, uint64_t{2});
+  ASSERT_EQ(s.pushed,   uint64_t{1});
+  ASSERT_EQ(s.executed, uint64_t{0});
+
+  {
+    core::TaskQueue::Worker w(&queue);
+    ASSERT_EQ(queue.sample().workers, uint64_t{1});
+
+    // The child is pushed to the worker's deque.
+    ASSERT_TRUE(w.Dequeue());
+  }
+  ASSERT_TRUE(queue.Dequeue());
+
+  s = queue.sample();
+  ASSERT_EQ(s.depth,    uint64_t{0});
+  ASSERT_EQ(s.attached, uint64_t{0});
+  ASSERT_EQ(s.workers,  uint64_t{0});
+  ASSERT_EQ(s.pushed,   uint64_t{2});
+  ASSERT_EQ(s.executed, uint64_t{2});
+
+  uint64_t latency = 0, exec = 0;
+  for (auto v : s.latency_us) latency += v;
+  for (auto v : s.exec_us) exec += v;
+  ASSERT_EQ(latency, uint64_t{2});
+  ASSERT_EQ(exec,    uint64_t{2});
+}
+
+TEST(TaskQueue, Priority) {
+  core::TaskQueue queue;
+
+  auto bg     = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto normal = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto inter  = std::make_shared<::testing::StrictMock<MockTask>>();
+  bg->priority(core::iTask::kBackground);
+  inter->priority(core::iTask::kInteractive);
+
+  ::testing::InSequence _;
+  EXPECT_CALL(*inter, DoExec());
+  EXPECT_CALL(*normal, DoExec());
+  EXPECT_CALL(*bg, DoExec());
+
+  for (auto& task : {bg, normal, inter}) {
+    queue.Attach(task);
+    task->Trigger();
+  }
+  while (queue.Dequeue()) continue;
+}
+
+TEST(TaskQueue, Deadline) {
+  core::TaskQueue queue;
+
+  const auto now = core::iTask::Clock::now();
+
+  auto none  = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto late  = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto early = std::make_shared<::testing::StrictMock<MockTask>>();
+  late->deadline(now + std::chrono::seconds(2));
+  early->deadline(now + std::chrono::seconds(1));
+
+  ::testing::InSequence _;
+  EXPECT_CALL(*early, DoExec());
+  EXPECT_CALL(*late, DoExec());
+  EXPECT_CALL(*none, DoExec());
+
+  for (auto& task : {none, late, early}) {
+    queue.Attach(task);
+    task->Trigger();
+  }
+  while (queue.Dequeue()) continue;
+}
+
+TEST(TaskQueue, BoostUpstream) {
+  core::TaskQueue queue;
+
+  auto a = std::make_shared<::testing::StrictMock<MockLambda>>(0, 1);
+  auto b = std::make_shared<::testing::StrictMock<MockLambda>>(1, 1);
+  auto c = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  a->Connect(0, b, 0);
+  b->Connect(0, c, 0);
+
+  auto other = std::make_shared<::testing::StrictMock<MockTask>>();
+  queue.Attach(other);
+  other->Trigger();
+
+  ASSERT_EQ(a->priority(), core::iTask::kNormal);
+  c->priority(core::iTask::kInteractive);
+  ASSERT_EQ(a->priority(), core::iTask::kInteractive);
+  ASSERT_EQ(b->priority(), core::iTask::kInteractive);
+
+  // Lowering the priority doesn't affect ancestors.
+  c->priority(core::iTask::kBackground);
+  ASSERT_EQ(a->priority(), core::iTask::kInteractive);
+
+  ::testing::InSequence _;
+  EXPECT_CALL(*a, DoExec());
+  EXPECT_CALL(*other, DoExec());
+
+  queue.Attach(a);
+  a->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_TRUE(queue.Dequeue());
+}
+
+TEST(TaskQueue, Cancel) {
+  core::TaskQueue queue;
+
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto grand  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+  child->AddChild(grand);
+
+  ::testing::InSequence _;
+  EXPECT_CALL(*parent, DoExec()).
+      WillOnce([p = parent.get()]() { p->Cancel(); });
+  EXPECT_CALL(*child, DoCancel());
+  EXPECT_CALL(*grand, DoCancel());
+
+  for (auto& task : {parent, child, grand}) {
+    queue.Attach(task);
+    task->Trigger();
+  }
+  while (queue.Dequeue()) continue;
+  ASSERT_TRUE(grand->cancelled());
+}
+
+TEST(TaskQueue, CancelEagerly) {
+  auto parent = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto child  = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto grand  = std::make_shared<::testing::StrictMock<MockTask>>();
+  parent->AddChild(child);
+  child->AddChild(grand);
+
+  // All descendants are marked before the parent is executed.
+  parent->Cancel();
+  ASSERT_TRUE(child->cancelled());
+  ASSERT_TRUE(grand->cancelled());
+}
+
+TEST(TaskQueue, CancelReleasesCaptures) {
+  core::TaskQueue queue;
+
+  auto str  = std::make_shared<std::string>("helloworld");
+  auto task = std::make_shared<core::Task>([str]() { });
+  ASSERT_EQ(str.use_count(), 2);
+
+  queue.Attach(task);
+  task->Cancel();
+  task->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(str.use_count(), 1);
+}
+
+TEST(TaskQueue, CancelToken) {
+  core::TaskQueue queue;
+
+  auto token = std::make_shared<core::CancelToken>();
+  auto a     = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto b     = std::make_shared<::testing::StrictMock<MockTask>>();
+  a->token(token);
+  b->token(token);
+
+  EXPECT_CALL(*a, DoCancel());
+  EXPECT_CALL(*b, DoCancel());
+
+  queue.Attach(a);
+  queue.Attach(b);
+  a->Trigger();
+  b->Trigger();
+
+  token->Cancel();
+  while (queue.Dequeue()) continue;
+}
+
+TEST(TaskQueue, CancelReleasesValues) {
+  core::TaskQueue queue;
+
+  auto str    = std::make_shared<std::string>("helloworld");
+  auto lambda = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  lambda->in(0, core::SharedAny(str));
+  ASSERT_EQ(str.use_count(), 2);
+
+  EXPECT_CALL(*lambda, DoCancel());
+
+  queue.Attach(lambda);
+  lambda->Cancel();
+  lambda->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(str.use_count(), 1);
+}
+
+TEST(TaskQueue, ShareValues) {
+  core::TaskQueue queue;
+
+  auto src  = std::make_shared<::testing::StrictMock<MockLambda>>(0, 1);
+  auto dst1 = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  auto dst2 = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  src->Connect(0, dst1, 0);
+  src->Connect(0, dst2, 0);
+
+  auto str = std::make_shared<std::string>("helloworld");
+  EXPECT_CALL(*src, DoExec()).
+      WillOnce([&]() { src->out(0, core::SharedAny(str)); });
+  EXPECT_CALL(*dst1, DoExec());
+  EXPECT_CALL(*dst2, DoExec());
+
+  queue.Attach(src);
+  queue.Attach(dst1);
+  queue.Attach(dst2);
+  src->Trigger();
+  dst1->Trigger();
+  dst2->Trigger();
+  while (queue.Dequeue()) continue;
+
+  // All consumers share a single value without copying.
+  ASSERT_TRUE(dst1->inRef(0));
+  ASSERT_EQ(dst1->inRef(0).get(), dst2->inRef(0).get());
+  ASSERT_EQ(str.use_count(), 2);
+
+  // The value can be passed through without copying.
+  auto pass = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  pass->in(0, dst1->inRef(0));
+  ASSERT_EQ(&pass->in(0), &dst2->in(0));
+}
+
+TEST(TaskQueue, CoLambda) {
+  class CoLambda : public core::iCoLambda {
+   public:
+    CoLambda(core::TaskQueue* sub, std::vector<int64_t>* log) :
+        iCoLambda(1, 1), sub_(sub), log_(log) {
+    }
+
+   protected:
+    Coroutine DoCoExec() override {
+      auto v = in<int64_t>(0);
+      log_->push_back(0);
+
+      auto task = std::make_shared<core::Task>([&v]() { v *= 2; });
+      sub_->Attach(task);
+      task->Trigger();
+      co_await Await(task);
+      log_->push_back(1);
+
+      co_await ResumeOn(sub_);
+      ++v;
+      log_->push_back(2);
+
+      co_await Yield();
+      log_->push_back(3);
+
+      out(0, v);
+    }
+
+   private:
+    core::TaskQueue* sub_;
+
+    std::vector<int64_t>* log_;
+  };
+
+  core::TaskQueue main, sub;
+  std::vector<int64_t> log;
+
+  auto lambda = std::make_shared<CoLambda>(&sub, &log);
+  auto taker  = std::make_shared<::testing::StrictMock<MockLambda>>(1, 0);
+  lambda->in(0, int64_t{20});
+  lambda->Connect(0, taker, 0);
+
+  int64_t result = 0;
+  EXPECT_CALL(*taker, DoExec()).
+      WillOnce([p = taker.get(), &result]() { result = p->in<int64_t>(0); });
+
+  main.Attach(lambda);
+  main.Attach(taker);
+  lambda->Trigger();
+  taker->Trigger();
+
+  ASSERT_TRUE(main.Dequeue());
+  ASSERT_EQ(log, (std::vector<int64_t> {0}));
+  ASSERT_EQ(lambda->state(), core::iTask::kTriggered);
+
+  // Executes the sub-task.
+  ASSERT_FALSE(main.Dequeue());
+  ASSERT_TRUE(sub.Dequeue());
+
+  // Resumes on the main, hops to the sub, and yields.
+  ASSERT_TRUE(main.Dequeue());
+  ASSERT_EQ(log, (std::vector<int64_t> {0, 1}));
+  ASSERT_TRUE(sub.Dequeue());
+  ASSERT_EQ(log, (std::vector<int64_t> {0, 1, 2}));
+  ASSERT_FALSE(main.Dequeue());
+  ASSERT_TRUE(sub.Dequeue());
+  ASSERT_EQ(log, (std::vector<int64_t> {0, 1, 2, 3}));
+  ASSERT_EQ(lambda->state(), core::iTask::kDone);
+
+  ASSERT_TRUE(main.Dequeue());
+  ASSERT_EQ(result, int64_t{41});
+}
+
+TEST(TaskQueue, CoLambdaAwaitCancelled) {
+  class CoLambda : public core::iCoLambda {
+   public:
+    explicit CoLambda(std::shared_ptr<core::iTask> wait) :
+        iCoLambda(0, 0), wait_(std::move(wait)) {
+    }
+
+    bool resumed = false;
+
+   protected:
+    Coroutine DoCoExec() override {
+      co_await Await(wait_);
+      resumed = wait_->cancelled();
+    }
+
+   private:
+    std::shared_ptr<core::iTask> wait_;
+  };
+
+  core::TaskQueue queue;
+
+  auto task = std::make_shared<::testing::StrictMock<MockTask>>();
+  EXPECT_CALL(*task, DoCancel());
+  queue.Attach(task);
+
+  auto lambda = std::make_shared<CoLambda>(task);
+  queue.Attach(lambda);
+  lambda->Trigger();
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(lambda->state(), core::iTask::kTriggered);
+
+  // The body is resumed even though the task resuming it is also cancelled.
+  task->Cancel();
+  task->Trigger();
+  while (queue.Dequeue()) continue;
+  ASSERT_TRUE(lambda->resumed);
+  ASSERT_EQ(lambda->state(), core::iTask::kDone);
+}
+
+TEST(TaskQueue, CoLambdaYieldOnWorker) {
+  class CoLambda : public core::iCoLambda {
+   public:
+    explicit CoLambda(std::vector<int64_t>* log) :
+        iCoLambda(0, 0), log_(log) {
+    }
+
+   protected:
+    Coroutine DoCoExec() override {
+      log_->push_back(1);
+      co_await Yield();
+      log_->push_back(3);
+    }
+
+   private:
+    std::vector<int64_t>* log_;
+  };
+
+  core::TaskQueue queue;
+  core::TaskQueue::Worker w(&queue);
+
+  std::vector<int64_t> log;
+
+  // Both are pushed to the worker's deque when the starter is done, and the
+  // lambda is popped first.
+  auto starter = std::make_shared<core::Task>([&log]() { log.push_back(0); });
+  auto task    = std::make_shared<core::Task>([&log]() { log.push_back(2); });
+  auto lambda  = std::make_shared<CoLambda>(&log);
+  starter->AddChild(task);
+  starter->AddChild(lambda);
+
+  for (auto t : std::initializer_list<std::shared_ptr<core::iTask>> {
+         task, lambda, starter}) {
+    queue.Attach(t);
+    t->Trigger();
+  }
+  while (w.Dequeue()) continue;
+
+  // The yielding body is resumed after the task got ready before.
+  ASSERT_EQ(log, (std::vector<int64_t> {0, 1, 2, 3}));
+  ASSERT_EQ(lambda->state(), core::iTask::kDone);
+}
+
+TEST(TaskGraph, Submit) {
+  core::TaskQueue queue;
+  core::TaskGraph graph;
+
+  // a -> (b, c) -> d
+  auto a = std::make_shared<::testing::StrictMock<MockLambda>>(0, 1);
+  auto b = std::make_shared<::testing::StrictMock<MockLambda>>(1, 1);
+  auto c = std::make_shared<::testing::StrictMock<MockLambda>>(1, 1);
+  auto d = std::make_shared<::testing::StrictMock<MockLambda>>(2, 0);
+
+  const auto ai = graph.Add(a);
+  const auto bi = graph.Add(b);
+  const auto ci = graph.Add(c);
+  const auto di = graph.Add(d);
+  graph.Connect(ai, 0, bi, 0);
+  graph.Connect(ai, 0, ci, 0);
+  graph.Connect(bi, 0, di, 0);
+  graph.Connect(ci, 0, di, 1);
+  ASSERT_TRUE(graph.Validate());
+
+  auto pa = a.get(), pb = b.get(), pc = c.get(), pd = d.get();
+  EXPECT_CALL(*a, DoExec()).
+      WillOnce([pa]() { pa->out(0, int64_t{1}); });
+  EXPECT_CALL(*b, DoExec()).
+      WillOnce([pb]() { pb->out(0, pb->in<int64_t>(0)+1); });
+  EXPECT_CALL(*c, DoExec()).
+      WillOnce([pc]() { pc->out(0, pc->in<int64_t>(0)+2); });
+
+  int64_t result = 0;
+  EXPECT_CALL(*d, DoExec()).
+      WillOnce([pd, &result]() {
+                 result = pd->in<int64_t>(0)+pd->in<int64_t>(1);
+               });
+
+  auto future = graph.Submit(&queue);
+  ASSERT_EQ(graph.size(), size_t{0});
+  ASSERT_EQ(queue.size(), size_t{5});
+
+  while (queue.Dequeue()) continue;
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  ASSERT_EQ(result, int64_t{5});
+}
+
+TEST(TaskGraph, Cycle) {
+  core::TaskGraph graph;
+
+  const auto a = graph.Add(std::make_shared<MockTask>());
+  const auto b = graph.Add(std::make_shared<MockTask>());
+  const auto c = graph.Add(std::make_shared<MockTask>());
+  graph.AddEdge(a, b);
+  graph.AddEdge(b, c);
+  ASSERT_TRUE(graph.Validate());
+
+  graph.AddEdge(c, a);
+  ASSERT_FALSE(graph.Validate());
+}
+
+TEST(TaskGraph, SubmitCycle) {
+  core::TaskQueue queue;
+  core::TaskGraph graph;
+
+  const auto a = graph.Add(std::make_shared<::testing::StrictMock<MockTask>>());
+  const auto b = graph.Add(std::make_shared<::testing::StrictMock<MockTask>>());
+  graph.AddEdge(a, b);
+  graph.AddEdge(b, a);
+
+  auto future = graph.Submit(&queue);
+  ASSERT_EQ(graph.size(), size_t{0});
+  ASSERT_EQ(queue.size(), size_t{0});
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  ASSERT_THROW(future.get(), std::invalid_argument);
+}
+
+TEST(TaskGraph, SubmitCancelled) {
+  core::TaskQueue queue;
+  core::TaskGraph graph;
+
+  auto a = std::make_shared<::testing::StrictMock<MockTask>>();
+  auto b = std::make_shared<::testing::StrictMock<MockTask>>();
+  const auto ai = graph.Add(a);
+  const auto bi = graph.Add(b);
+  graph.AddEdge(ai, bi);
+
+  EXPECT_CALL(*a, DoExec()).WillOnce([p = a.get()]() { p->Cancel(); });
+  EXPECT_CALL(*b, DoCancel());
+
+  auto future = graph.Submit(&queue);
+  while (queue.Dequeue()) continue;
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  ASSERT_THROW(future.get(), core::CancelledError);
+}
+
+TEST(TaskGraph, SubmitEmpty) {
+  core::TaskQueue queue;
+  core::TaskGraph graph;
+
+  auto future = graph.Submit(&queue);
+  ASSERT_TRUE(queue.Dequeue());
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+}
+
+TEST(TaskDeque, PushPopSteal) {
+  static constexpr size_t kCount   = 10000;
+  static constexpr size_t kThieves = 4;
+
+  // Tasks are never executed, just used as unique pointers.
+  std::vector<std::unique_ptr<MockTask>> tasks(kCount);
+  std::unordered_map<core::iTask*, size_t> indices;
+  for (size_t i = 0; i < kCount; ++i) {
+    tasks[i] = std::make_unique<MockTask>();
+    indices[tasks[i].get()] = i;
+  }
+
+  core::TaskDeque deque(2);  // grows many times
+  std::vector<std::atomic<size_t>> taken(kCount);
+
+  auto take = [&](core::iTask* task) { ++taken[indices.at(task)]; };
+
+  std::atomic<bool> alive = true;
+
+  std::vector<std::thread> thieves;
+  for (size_t i = 0; i < kThieves; ++i) {
+    thieves.emplace_back([&]() {
+                           while (alive || !deque.empty()) {
+                             if (auto task = deque.Steal()) take(task);
+                           }
+                         });
+  }
+  for (size_t i = 0; i < kCount; ++i) {
+    deque.Push(tasks[i].get());
+    if (i%3 == 0) {
+      if (auto task = deque.Pop()) take(task);
+    }
+  }
+  alive = false;
+  for (auto& th : thieves) th.join();
+
+  for (size_t i = 0; i < kCount; ++i) {
+    ASSERT_EQ(taken[i], size_t{1});
+  }
+}
+
+
 using TaskWorkerTestParam = std::tuple<size_t, size_t, size_t>;
 
 class TaskWorkerTest : public ::testing::TestWithParam<TaskWorkerTestParam> {
@@ -22,11 +791,11 @@ class TaskWorkerTest : public ::testing::TestWithParam<TaskWorkerTestParam> {
   void SetUp() override {
     auto [threads, delay, count] = GetParam();
 
+    delay_ = delay;
+    count_ = count;
     for (size_t i = 0; i < threads; ++i) {
       threads_.emplace_back([this]() { return WorkerMain(); });
     }
-    delay_ = delay;
-    count_ = count;
   }
 
   void TearDown() override {
@@ -44,11 +813,10 @@ class TaskWorkerTest : public ::testing::TestWithParam<TaskWorkerTestParam> {
 
  private:
   void WorkerMain() {
+    core::TaskQueue::Worker w(&queue_);
     while (alive_ || queue_.size()) {
       std::this_thread::sleep_for(std::chrono::milliseconds(delay_));
-      if (!queue_.Dequeue()) {
-        queue_.Sleep(std::chrono::milliseconds(10));
-      }
+      if (!w.Dequeue()) w.Park();
     }
   }
 
@@ -162,6 +930,57 @@ TEST_P(TaskWorkerTest, ExecLambdaTree) {
   }
 }
 
+TEST_P(TaskWorkerTest, SubmitGraph) {
+  core::TaskGraph graph;
+
+  std::atomic<size_t> done = 0;
+  size_t prev = 0;
+  for (size_t i = 0; i < count_; ++i) {
+    auto task = std::make_shared<::testing::StrictMock<MockTask>>();
+    EXPECT_CALL(*task, DoExec()).WillOnce([&done]() { ++done; });
+
+    const auto index = graph.Add(task);
+    if (i) graph.AddEdge(prev, index);
+    prev = index;
+  }
+  graph.Submit(&queue_).wait();
+  ASSERT_EQ(done, count_);
+}
+
+TEST_P(TaskWorkerTest, ExecCoLambda) {
+  class CoLambda : public core::iCoLambda {
+   public:
+    explicit CoLambda(std::atomic<size_t>* done) :
+        iCoLambda(0, 0), done_(done) {
+    }
+
+   protected:
+    Coroutine DoCoExec() override {
+      size_t sum = 0;
+      for (size_t i = 0; i < 2; ++i) {
+        auto task = std::make_shared<core::Task>([&sum, i]() { sum += i; });
+        queue()->Attach(task);
+        task->Trigger();
+        co_await Await(task);
+        co_await Yield();
+      }
+      if (sum == 1) ++*done_;
+    }
+
+   private:
+    std::atomic<size_t>* done_;
+  };
+
+  std::atomic<size_t> done = 0;
+
+  core::TaskGraph graph;
+  for (size_t i = 0; i < count_; ++i) {
+    graph.Add(std::make_shared<CoLambda>(&done));
+  }
+  graph.Submit(&queue_).wait();
+  ASSERT_EQ(done, count_);
+}
+
 INSTANTIATE_TEST_SUITE_P(
     TaskQueue,
     TaskWorkerTest,
@@ -20,6 +20,7 @@ class MockTask : public core::iTask {
 
 
   MOCK_METHOD(void, DoExec, (), (override));
+  MOCK_METHOD(void, DoCancel, (), (override));
 };
 
 class MockLambda : public core::iLambda {
@@ -36,10 +37,12 @@ class MockLambda : public core::iLambda {
 
 
   MOCK_METHOD(void, DoExec, (), (override));
+  MOCK_METHOD(void, DoCancel, (), (override));
 
 
   using iLambda::in;
   using iLambda::out;
+  using iLambda::inRef;
 };
 
 }  // namespace mnian::test
@@ -0,0 +1,126 @@
+// No copyright
+#include "mncore/tensor.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "mncore/conv.h"
+#include "mncore/node.h"
+#include "mncore/task.h"
+
+
+namespace mnian::test {
+
+static std::shared_ptr<const core::Tensor> MakeSequence(size_t h, size_t w) {
+  core::Tensor::Builder b(core::Tensor::kF32, {h, w});
+  for (size_t y = 0; y < h; ++y) {
+    for (size_t x = 0; x < w; ++x) {
+      b.at<float>({y, x}) = static_cast<float>(y*w+x);
+    }
+  }
+  return b.Build();
+}
+
+
+TEST(Tensor, Create) {
+  auto t = core::Tensor::Create(core::Tensor::kI32, {2, 3, 4});
+  ASSERT_EQ(t->size(),  size_t{24});
+  ASSERT_EQ(t->bytes(), size_t{96});
+  ASSERT_EQ(t->strides(), (core::Tensor::Strides {12, 4, 1}));
+  ASSERT_TRUE(t->contiguous());
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(t->ptr()) % core::Tensor::kAlign,
+            uintptr_t{0});
+  for (size_t i = 0; i < t->size(); ++i) ASSERT_EQ(t->data<int32_t>()[i], 0);
+}
+
+TEST(Tensor, Builder) {
+  core::Tensor::Builder b(core::Tensor::kI32, {2, 3});
+  b.at<int32_t>({1, 2}) = 5;
+  const auto ptr = b.ptr();
+
+  // The storage is handed over without copying.
+  auto t = b.Build();
+  ASSERT_EQ(t->ptr(), ptr);
+  ASSERT_EQ(t->at<int32_t>({1, 2}), 5);
+  ASSERT_EQ(t->data<int32_t>()[5], 5);
+
+  // Published tensors and their storage can't be written or copied.
+  static_assert(
+      std::is_same<core::Tensor::Storage,
+                   std::shared_ptr<const std::byte>>::value);
+  static_assert(!std::is_copy_constructible<core::Tensor>::value);
+  static_assert(!std::is_copy_assignable<core::Tensor>::value);
+}
+
+TEST(Tensor, View) {
+  auto t = MakeSequence(3, 4);
+
+  // Views share the storage without copying.
+  auto s = t->Slice(1, 3);
+  ASSERT_EQ(s->shape(), (core::Tensor::Shape {2, 4}));
+  ASSERT_EQ(s->storage(), t->storage());
+  ASSERT_EQ(s->at<float>({0, 0}), 4.f);
+
+  auto tr = t->Transpose();
+  ASSERT_FALSE(tr->contiguous());
+  ASSERT_EQ(tr->at<float>({3, 2}), 11.f);
+  ASSERT_EQ(tr->at<float>({1, 2}), 9.f);
+
+  auto c = tr->Copy();
+  ASSERT_TRUE(c->contiguous());
+  ASSERT_EQ(c->data<float>()[1], 4.f);
+}
+
+TEST(Tensor, Encode) {
+  auto t   = MakeSequence(2, 3);
+  auto str = t->Encode();
+  ASSERT_EQ(str.substr(0, 8), "f32;2,3;");
+
+  auto d = core::Tensor::Decode(str);
+  ASSERT_TRUE(d);
+  ASSERT_EQ(d->shape(), t->shape());
+  ASSERT_EQ(d->at<float>({1, 2}), 5.f);
+
+  // A transposed view is encoded in its own order.
+  auto tr = core::Tensor::Decode(t->Transpose()->Encode());
+  ASSERT_TRUE(tr);
+  ASSERT_EQ(tr->at<float>({2, 1}), 5.f);
+
+  ASSERT_FALSE(core::Tensor::Decode("f32;2,3;AAAA"));
+  ASSERT_FALSE(core::Tensor::Decode("x;2;"));
+  ASSERT_FALSE(core::Tensor::Decode("helloworld"));
+
+  // A shape not matching the data is refused before allocation.
+  ASSERT_FALSE(core::Tensor::Decode("f32;1000000000,1000000000;AAAA"));
+
+  // 2^32 * 2^32 wraps to zero, which matches the empty data.
+  ASSERT_FALSE(core::Tensor::Decode("u8;4294967296,4294967296;"));
+  ASSERT_TRUE(core::Tensor::Decode("u8;4294967296,0;"));
+}
+
+TEST(Tensor, SharedAny) {
+  auto t = MakeSequence(2, 2);
+
+  core::SharedAny v = t;
+  ASSERT_EQ(core::iNode::Socket::GetTypeFromValue(v),
+            core::iNode::Socket::kTensor);
+
+  // Passing through lambdas shares the tensor.
+  auto value = core::iLambda::MakeValue(core::SharedAny(v));
+  ASSERT_EQ(std::get<std::shared_ptr<const core::Tensor>>(*value), t);
+
+  // Serialization encodes into string, and the socket restores it.
+  const auto any = core::FromSharedAny(v);
+  core::iNode::Socket sock(
+      0, core::iNode::Socket::Meta {"t"},
+      core::SharedAny(MakeSequence(1, 1)));
+  auto restored = sock.Restore(core::ToSharedAny(any));
+  const auto& rt = std::get<std::shared_ptr<const core::Tensor>>(restored);
+  ASSERT_EQ(rt->at<float>({1, 1}), 3.f);
+}
+
+}  // namespace mnian::test
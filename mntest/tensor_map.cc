@@ -0,0 +1,156 @@
+// No copyright
+#include "mncore/tensor_map.h"
+#include "mntest/file.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <filesystem>  // NOLINT(build/c++11)
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace mnian::test {
+
+class TensorMap : public ::testing::Test {
+ public:
+  static inline const std::string kPath = "./test-TensorMap/";
+
+  TensorMap() = default;
+
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(std::filesystem::create_directory(kPath));
+    dir_created_ = true;
+  }
+  void TearDown() override {
+    if (dir_created_) {
+      ASSERT_TRUE(std::filesystem::remove_all(kPath));
+    }
+  }
+
+  static void WriteFloats(const std::vector<float>& v) {
+    std::ofstream st(kPath+"file", std::ios::binary);
+    st.write(reinterpret_cast<const char*>(v.data()),
+             static_cast<std::streamsize>(v.size()*sizeof(float)));
+  }
+
+  // Moves the last modified time forward, because it might not change with
+  // quick writes.
+  static void Touch() {
+    const auto path = kPath+"file";
+    std::filesystem::last_write_time(
+        path,
+        std::filesystem::last_write_time(path)+std::chrono::seconds(1));
+  }
+
+ private:
+  bool dir_created_ = false;
+};
+
+
+TEST_F(TensorMap, Get) {
+  WriteFloats({0, 1, 2, 3, 4, 5});
+
+  auto f = core::iFile::CreateForNative(kPath+"file");
+  core::TensorMap map(f.get(), core::Tensor::kF32, {2, 3});
+
+  const auto t = map.Get();
+  ASSERT_TRUE(t);
+  ASSERT_EQ(t->shape(), (core::Tensor::Shape {2, 3}));
+  ASSERT_EQ(t->at<float>({0, 0}), 0.f);
+  ASSERT_EQ(t->at<float>({1, 2}), 5.f);
+  ASSERT_EQ(map.Get(), t);
+
+  // The view shares pages with the file.
+  const float v = 10;
+  ASSERT_EQ(f->Lock().Write(reinterpret_cast<const uint8_t*>(&v), sizeof(v)),
+            sizeof(v));
+  ASSERT_EQ(t->at<float>({0, 0}), 10.f);
+}
+
+TEST_F(TensorMap, Offset) {
+  WriteFloats({0, 1, 2, 3, 4, 5});
+
+  auto f = core::iFile::CreateForNative(kPath+"file");
+  core::TensorMap map(f.get(), core::Tensor::kF32, {4}, sizeof(float)*2);
+
+  const auto t = map.Get();
+  ASSERT_TRUE(t);
+  ASSERT_EQ(t->at<float>({0}), 2.f);
+  ASSERT_EQ(t->at<float>({3}), 5.f);
+}
+
+TEST_F(TensorMap, TooSmall) {
+  WriteFloats({0, 1, 2});
+
+  auto f = core::iFile::CreateForNative(kPath+"file");
+  core::TensorMap map(f.get(), core::Tensor::kF32, {4});
+  ASSERT_FALSE(map.Get());
+
+  core::TensorMap map_offset(f.get(), core::Tensor::kF32, {3}, sizeof(float));
+  ASSERT_FALSE(map_offset.Get());
+}
+
+TEST_F(TensorMap, Remap) {
+  WriteFloats({0, 1});
+
+  auto f = core::iFile::CreateForNative(kPath+"file");
+  f->Lock().Watch();
+
+  core::TensorMap map(f.get(), core::Tensor::kF32, {4});
+  ASSERT_FALSE(map.Get());
+
+  WriteFloats({0, 1, 2, 3});
+  Touch();
+  f->Lock().Watch();
+  ASSERT_EQ(map.version(), 1);
+
+  const auto t = map.Get();
+  ASSERT_TRUE(t);
+  ASSERT_EQ(t->at<float>({3}), 3.f);
+
+  // The old view keeps its mapping after the update.
+  WriteFloats({4, 5, 6, 7, 8});
+  Touch();
+  f->Lock().Watch();
+  ASSERT_EQ(map.version(), 2);
+  ASSERT_EQ(t->at<float>({0}), 4.f);
+
+  const auto t2 = map.Get();
+  ASSERT_TRUE(t2);
+  ASSERT_NE(t2, t);
+  ASSERT_EQ(t2->at<float>({3}), 7.f);
+}
+
+TEST_F(TensorMap, Truncate) {
+  WriteFloats({0, 1, 2, 3});
+
+  auto f = core::iFile::CreateForNative(kPath+"file");
+  {
+    core::TensorMap map(f.get(), core::Tensor::kF32, {4});
+    const auto t = map.Get();
+    ASSERT_TRUE(t);
+
+    // The file can't shrink under the live view.
+    ASSERT_FALSE(f->Lock().Truncate(sizeof(float)*2));
+    ASSERT_TRUE(f->Lock().Truncate(sizeof(float)*8));
+    ASSERT_EQ(t->at<float>({3}), 3.f);
+  }
+
+  // It can after the view and the map are dropped.
+  ASSERT_TRUE(f->Lock().Truncate(sizeof(float)*2));
+}
+
+TEST(TensorMap_Mock, Unsupported) {
+  MockFile file("test");
+
+  core::TensorMap map(&file, core::Tensor::kF32, {1});
+  ASSERT_FALSE(map.Get());
+
+  file.NotifyUpdate();
+  ASSERT_EQ(map.version(), 1);
+}
+
+}  // namespace mnian::test
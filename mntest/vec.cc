@@ -0,0 +1,99 @@
+// No copyright
+#include "mncore/vec.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "mncore/conv.h"
+#include "mncore/memo.h"
+#include "mncore/node.h"
+
+#include "mntest/serialize.h"
+
+
+namespace mnian::test {
+
+TEST(Vec, Stringify) {
+  const core::Vec3 v(1, .5, -3);
+
+  const auto str = core::StringifyVec(v);
+  ASSERT_EQ(str, "1,0.5,-3");
+
+  const auto p = core::ParseVec<3>(str);
+  ASSERT_TRUE(p);
+  ASSERT_EQ(p->x, 1);
+  ASSERT_EQ(p->y, .5);
+  ASSERT_EQ(p->z, -3);
+
+  ASSERT_FALSE(core::ParseVec<2>(str));
+  ASSERT_FALSE(core::ParseVec<4>(str));
+  ASSERT_FALSE(core::ParseVec<2>("1,"));
+  ASSERT_FALSE(core::ParseVec<2>("1,x"));
+}
+
+TEST(Vec, Batch) {
+  std::vector<core::Vec2> a = {{1, 2}, {3, 4}, {0, 0}};
+  std::vector<core::Vec2> b = {{2, 0}, {0, 2}, {1, 1}};
+
+  std::vector<double> d(3);
+  core::Dot<2>(a, b, d);
+  ASSERT_EQ(d, (std::vector<double> {2, 8, 0}));
+
+  std::vector<core::Vec2> l(3);
+  core::Lerp<2>(a, b, .5, l);
+  ASSERT_EQ(l[1].x, 1.5);
+  ASSERT_EQ(l[1].y, 3);
+
+  core::Axpy<2>(2, b, a);
+  ASSERT_EQ(a[0].x, 5);
+  ASSERT_EQ(a[0].y, 2);
+
+  core::Normalize<2>(a);
+  core::Length<2>(a, d);
+  ASSERT_DOUBLE_EQ(d[0], 1);
+  ASSERT_DOUBLE_EQ(d[1], 1);
+  ASSERT_DOUBLE_EQ(d[2], 1);
+
+  const auto [lo, hi] = core::Bounds<2>(b);
+  ASSERT_EQ(lo.x, 0);
+  ASSERT_EQ(lo.y, 0);
+  ASSERT_EQ(hi.x, 2);
+  ASSERT_EQ(hi.y, 2);
+}
+
+TEST(Vec, SharedAny) {
+  const core::SharedAny v = core::Vec4(1, 2, 3, 4);
+  ASSERT_EQ(core::iNode::Socket::GetTypeFromValue(v),
+            core::iNode::Socket::kVec4);
+
+  core::iNode::Socket sock(
+      0, core::iNode::Socket::Meta {"v"}, core::SharedAny(core::Vec4()));
+
+  // A string made by FromSharedAny() is restored.
+  auto restored = sock.Restore(core::ToSharedAny(core::FromSharedAny(v)));
+  ASSERT_EQ(std::get<core::Vec4>(restored).w, 4);
+
+  // A vector of different size is replaced by the default.
+  restored = sock.Restore(core::Vec2(1, 2));
+  ASSERT_EQ(std::get<core::Vec4>(restored).x, 0);
+
+  // Hash depends on components.
+  core::Hasher h1, h2;
+  h1.AddValue(v);
+  h2.AddValue(core::Vec4(1, 2, 3, 5));
+  ASSERT_NE(h1.value(), h2.value());
+}
+
+TEST(Vec, Serialize) {
+  ::testing::StrictMock<MockSerializer> serial;
+  {
+    ::testing::InSequence _;
+    EXPECT_CALL(serial, SerializeArray(size_t{2}));
+    EXPECT_CALL(serial, SerializeValue(core::Any(1.)));
+    EXPECT_CALL(serial, SerializeValue(core::Any(2.)));
+  }
+  serial.SerializeSharedAny(core::Vec2(1, 2));
+}
+
+}  // namespace mnian::test